@@ -0,0 +1,656 @@
+/**
+ * Headless benchmark of the glow render path.
+ *
+ * Draws synthetic windows into an offscreen framebuffer on a surfaceless EGL
+ * context (Mesa llvmpipe is fine, no GPU needed) through the same programs,
+ * ring lattice and uniform helpers as the plugin, the way render_single()
+ * and render_batch() issue them, and writes per-scenario results as JSON.
+ * Every scenario is also drawn by the CPU kernel of glow-cpu.hpp, timed, and
+ * its last frame compared against the shader variant of the features the
+ * kernel covers.
+ *
+ *   glow-bench [--frames N] [--width W] [--height H] [--output FILE]
+ */
+
+#include "glow-cpu.hpp"
+#include "glow-render.hpp"
+#include "shaders.hpp"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl3.h>
+#include <dlfcn.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace wf::glow_decoration;
+
+// Counters of the measured section of each frame
+static uint64_t gl_calls = 0;
+static uint64_t draw_calls = 0;
+static uint64_t allocations = 0;
+
+// Every C++ heap allocation of the process; GL driver allocations are not seen
+void* operator new(std::size_t size) {
+    allocations++;
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+/**
+ * The GL entry points used while drawing are interposed: the definitions
+ * below take precedence over libGLESv2 for this executable, count the call
+ * and forward it to the driver.
+ */
+#define GLOW_BENCH_COUNTED(name, params, args, extra) \
+    extern "C" void GL_APIENTRY name params { \
+        using fn_t = void (GL_APIENTRY *) params; \
+        static auto real = reinterpret_cast<fn_t>(dlsym(RTLD_NEXT, #name)); \
+        gl_calls++; \
+        extra; \
+        real args; \
+    }
+
+GLOW_BENCH_COUNTED(glUseProgram, (GLuint program), (program), )
+GLOW_BENCH_COUNTED(glUniform1f, (GLint l, GLfloat x), (l, x), )
+GLOW_BENCH_COUNTED(glUniform2f, (GLint l, GLfloat x, GLfloat y), (l, x, y), )
+GLOW_BENCH_COUNTED(glUniform3f, (GLint l, GLfloat x, GLfloat y, GLfloat z), (l, x, y, z), )
+GLOW_BENCH_COUNTED(glUniform4f, (GLint l, GLfloat x, GLfloat y, GLfloat z, GLfloat w),
+    (l, x, y, z, w), )
+GLOW_BENCH_COUNTED(glUniform1i, (GLint l, GLint x), (l, x), )
+GLOW_BENCH_COUNTED(glBindBuffer, (GLenum target, GLuint buffer), (target, buffer), )
+GLOW_BENCH_COUNTED(glBindBufferBase, (GLenum target, GLuint index, GLuint buffer),
+    (target, index, buffer), )
+GLOW_BENCH_COUNTED(glBufferData, (GLenum target, GLsizeiptr size, const void *data, GLenum usage),
+    (target, size, data, usage), )
+GLOW_BENCH_COUNTED(glBufferSubData,
+    (GLenum target, GLintptr offset, GLsizeiptr size, const void *data),
+    (target, offset, size, data), )
+GLOW_BENCH_COUNTED(glBindVertexArray, (GLuint array), (array), )
+GLOW_BENCH_COUNTED(glEnable, (GLenum cap), (cap), )
+GLOW_BENCH_COUNTED(glDisable, (GLenum cap), (cap), )
+GLOW_BENCH_COUNTED(glBlendFunc, (GLenum src, GLenum dst), (src, dst), )
+GLOW_BENCH_COUNTED(glScissor, (GLint x, GLint y, GLsizei w, GLsizei h), (x, y, w, h), )
+GLOW_BENCH_COUNTED(glActiveTexture, (GLenum unit), (unit), )
+GLOW_BENCH_COUNTED(glBindTexture, (GLenum target, GLuint texture), (target, texture), )
+GLOW_BENCH_COUNTED(glGetIntegerv, (GLenum pname, GLint *data), (pname, data), )
+GLOW_BENCH_COUNTED(glDrawElements,
+    (GLenum mode, GLsizei count, GLenum type, const void *indices),
+    (mode, count, type, indices), draw_calls++)
+GLOW_BENCH_COUNTED(glDrawElementsInstanced,
+    (GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances),
+    (mode, count, type, indices, instances), draw_calls++)
+
+struct scenario_t {
+    const char *name;
+    int windows;
+    float glow_radius;
+    float corner_radius;
+    float glow_intensity;
+    float animation_speed;
+    bool gradient;
+    bool instanced;
+    bool atlas;          // sample a baked shape, as the plugin does for static looks
+};
+
+static const scenario_t scenarios[] = {
+    {"border-only",              16, 20.0f, 10.0f, 0.0f, 0.0f, false, false, false},
+    {"atlas-square",             16, 20.0f,  0.0f, 1.0f, 0.0f, false, false, true},
+    {"atlas-rounded",            16, 20.0f, 10.0f, 1.0f, 0.0f, false, false, true},
+    {"analytic-static-square",   16, 20.0f,  0.0f, 1.0f, 0.0f, false, false, false},
+    {"analytic-static-rounded",  16, 20.0f, 10.0f, 1.0f, 0.0f, false, false, false},
+    {"gradient",                 16, 20.0f, 10.0f, 1.0f, 0.0f, true,  false, false},
+    {"animated",                 16, 20.0f, 10.0f, 1.0f, 1.0f, false, false, false},
+    {"full",                     16, 20.0f, 10.0f, 1.0f, 1.0f, true,  false, false},
+    {"full-large-radius",        16, 50.0f, 16.0f, 1.0f, 1.0f, true,  false, false},
+    {"full-many",                64, 20.0f, 10.0f, 1.0f, 1.0f, true,  false, false},
+    {"full-batched",             16, 20.0f, 10.0f, 1.0f, 1.0f, true,  true,  false},
+    {"full-many-batched",        64, 20.0f, 10.0f, 1.0f, 1.0f, true,  true,  false},
+};
+
+struct options_t {
+    int frames = 200;
+    int width = 1920;
+    int height = 1080;
+    const char *output = nullptr;
+};
+
+struct result_t {
+    const scenario_t *scenario;
+    uint32_t features;
+    double frame_ms;
+    double cpu_ms;
+    double fragments;
+    double gl_calls;
+    double draw_calls;
+    double allocations;
+    double uniform_uploads;
+    double uniform_uploads_skipped;
+    double cpu_kernel_ms;
+    int max_diff;        // largest channel difference to the shader, 0..255
+    double mean_diff;    // over all channels of the target
+};
+
+struct window_t {
+    float x, y, width, height;
+};
+
+// Deterministic layout, so runs are comparable across builds
+static std::vector<window_t> make_windows(int count, int width, int height) {
+    uint32_t seed = 0x9e3779b9u;
+    auto next = [&seed] (float lo, float hi) {
+        seed = seed * 1664525u + 1013904223u;
+        return lo + (hi - lo) * ((seed >> 8) / float(1u << 24));
+    };
+    
+    std::vector<window_t> windows;
+    for (int i = 0; i < count; i++) {
+        window_t window;
+        window.width = std::floor(next(width / 8.0f, width / 2.0f));
+        window.height = std::floor(next(height / 8.0f, height / 2.0f));
+        window.x = std::floor(next(-window.width / 4, width - window.width * 0.75f));
+        window.y = std::floor(next(-window.height / 4, height - window.height * 0.75f));
+        windows.push_back(window);
+    }
+    
+    return windows;
+}
+
+static glow_instance_t make_instance(const window_t& w, const glm::vec4& color,
+    const glow_config_t& config, float time) {
+    glow_instance_t window;
+    window.border_box[0] = w.x;
+    window.border_box[1] = w.y;
+    window.border_box[2] = w.width;
+    window.border_box[3] = w.height;
+    for (int c = 0; c < 4; c++) {
+        window.glow_color[c] = color[c];
+        window.glow_color_2[c] = config.gradient_color_2[c];
+    }
+    
+    window.time = time;
+    return window;
+}
+
+// Fragments rasterized for one ring inside the target; discarded ones included
+static double ring_fragments(const glow_ring_t& ring, int width, int height) {
+    double total = 0.0;
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) {
+            if (i == 1 && j == 1) continue;
+            float x1 = std::clamp(ring.x[i], 0.0f, float(width));
+            float x2 = std::clamp(ring.x[i + 1], 0.0f, float(width));
+            float y1 = std::clamp(ring.y[j], 0.0f, float(height));
+            float y2 = std::clamp(ring.y[j + 1], 0.0f, float(height));
+            total += std::max(x2 - x1, 0.0f) * std::max(y2 - y1, 0.0f);
+        }
+    }
+    
+    return total;
+}
+
+/**
+ * The one shape of an atlas scenario, baked and sampled the way
+ * glow_texture_cache_t does it in the plugin, which needs the compositor
+ * to be linked in. Baked once, like the plugin bakes a shape on first use.
+ */
+struct atlas_t {
+    static constexpr int SIZE = 512;     // glow_texture_cache_t::ATLAS_SIZE
+    
+    GLuint texture = 0;
+    GLuint framebuffer = 0;
+    glow_program_t bake_program;
+    glow_program_t sample_program;
+    int tile_size = 0;
+    
+    bool create(const glow_config_t& config, const glow_geometry_t& geometry,
+        const options_t& options) {
+        if (!bake_program.compile_shaders(glow_bake_vertex_shader, glow_bake_fragment_shader) ||
+            !sample_program.compile_shaders(glow_vertex_shader, glow_cached_fragment_shader)) {
+            fprintf(stderr, "atlas: %s%s\n", bake_program.error_log.c_str(),
+                sample_program.error_log.c_str());
+            return false;
+        }
+        
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SIZE, SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GLint target;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        
+        tile_size = static_cast<int>(std::ceil(config.glow_radius + config.border_width +
+            config.corner_radius));
+        glViewport(0, 0, tile_size, tile_size + 1);
+        glDisable(GL_BLEND);
+        bake_program.use();
+        bake_program.set_uniform(bake_program.u_tile_origin, 0.0f, 0.0f);
+        bake_program.set_uniform(bake_program.u_glow_radius, config.glow_radius);
+        bake_program.set_uniform(bake_program.u_border_width, config.border_width);
+        bake_program.set_uniform(bake_program.u_corner_radius, config.corner_radius);
+        glBindVertexArray(geometry.vao);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glBindVertexArray(0);
+        
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(0, 0, options.width, options.height);
+        return glGetError() == GL_NO_ERROR;
+    }
+    
+    // Windows too small for an unclamped corner fall back to the analytic shader
+    bool can_sample(const window_t& w, const glow_config_t& config) const {
+        return texture && std::min(w.width, w.height) >= 2.0f * (config.border_width + config.corner_radius);
+    }
+    
+    void bind(const glow_config_t& config) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        sample_program.set_uniform_int(sample_program.u_atlas, 0);
+        sample_program.set_uniform(sample_program.u_atlas_size, SIZE, SIZE);
+        sample_program.set_uniform(sample_program.u_atlas_tile, 0, 0, tile_size);
+        sample_program.set_uniform(sample_program.u_glow_radius, config.glow_radius);
+        sample_program.set_uniform(sample_program.u_glow_intensity, config.glow_intensity);
+        sample_program.set_uniform(sample_program.u_border_width, config.border_width);
+        sample_program.set_uniform(sample_program.u_corner_radius, config.corner_radius);
+    }
+    
+    void destroy() {
+        bake_program.destroy();
+        sample_program.destroy();
+        if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+        if (texture) glDeleteTextures(1, &texture);
+        framebuffer = texture = 0;
+    }
+};
+
+static bool init_context(EGLDisplay& display, EGLContext& context) {
+    auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    display = get_platform_display ?
+        get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr) :
+        EGL_NO_DISPLAY;
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    
+    if (!eglInitialize(display, nullptr, nullptr) || !eglBindAPI(EGL_OPENGL_ES_API)) {
+        return false;
+    }
+    
+    const EGLint attribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE};
+    context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attribs);
+    return context != EGL_NO_CONTEXT &&
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+/**
+ * Times the CPU kernel on the same frames as the scenario, with the features
+ * it lacks dropped the way the quality governor drops them, and compares its
+ * last frame with the shader variant of the same reduced features.
+ */
+static bool run_cpu_kernel(const glow_config_t& config, uint32_t features,
+    const std::vector<window_t>& windows, const options_t& options,
+    glow_geometry_t& geometry, GLuint config_ubo, result_t& result) {
+    features &= GLOW_CPU_FEATURES;
+    std::vector<uint32_t> pixels(size_t(options.width) * options.height);
+    glow_cpu_target_t target{pixels.data(), options.width, options.height, options.width};
+    glow_cpu_clip_t clip{0, 0, options.width, options.height};
+    glow_cpu_renderer_t renderer;
+    float time = 0.0f;
+    
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.frames; frame++) {
+        std::fill(pixels.begin(), pixels.end(), 0u);
+        time = frame / 60.0f * config.animation_speed;
+        for (size_t i = windows.size(); i-- > 0;) {
+            glm::vec4 color = (i == 0) ? config.active_color : config.inactive_color;
+            renderer.draw(target, clip, config, features, make_instance(windows[i], color, config, time));
+        }
+    }
+    
+    auto finished = std::chrono::steady_clock::now();
+    result.cpu_kernel_ms = std::chrono::duration<double, std::milli>(finished - start).count() /
+        std::max(options.frames, 1);
+    
+    glow_program_t program;
+    auto vertex_source = build_glow_vertex_source(features);
+    auto fragment_source = build_glow_fragment_source(features);
+    if (!program.compile_shaders(vertex_source.c_str(), fragment_source.c_str())) {
+        fprintf(stderr, "reference variant %u: %s\n", features, program.error_log.c_str());
+        program.destroy();
+        return false;
+    }
+    
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    program.use();
+    glBindBufferBase(GL_UNIFORM_BUFFER, GLOW_CONFIG_BINDING, config_ubo);
+    program.set_uniform(program.u_resolution, options.width, options.height);
+    glBindVertexArray(geometry.vao);
+    for (size_t i = windows.size(); i-- > 0;) {
+        auto& w = windows[i];
+        glm::vec4 color = (i == 0) ? config.active_color : config.inactive_color;
+        set_glow_window_uniforms(program, compute_glow_ring(w.x, w.y, w.width, w.height, config),
+            make_instance(w, color, config, time));
+        glDrawElements(GL_TRIANGLES, GLOW_RING_INDEX_COUNT, GL_UNSIGNED_BYTE, nullptr);
+    }
+    
+    glBindVertexArray(0);
+    program.destroy();
+    
+    // Rows come back bottom-up, which is y-down here: the ring maps y to GL row y
+    std::vector<uint8_t> gpu(pixels.size() * 4);
+    glReadPixels(0, 0, options.width, options.height, GL_RGBA, GL_UNSIGNED_BYTE, gpu.data());
+    double total = 0.0;
+    for (size_t i = 0; i < pixels.size(); i++) {
+        const int shifts[4] = {16, 8, 0, 24};
+        for (int c = 0; c < 4; c++) {
+            int diff = std::abs(int((pixels[i] >> shifts[c]) & 0xff) - int(gpu[i * 4 + c]));
+            result.max_diff = std::max(result.max_diff, diff);
+            total += diff;
+        }
+    }
+    
+    result.mean_diff = total / (pixels.size() * 4);
+    return true;
+}
+
+static bool run_scenario(const scenario_t& scenario, const options_t& options,
+    glow_geometry_t& geometry, GLuint config_ubo, result_t& result) {
+    glow_config_t config;
+    config.glow_radius = scenario.glow_radius;
+    config.corner_radius = scenario.corner_radius;
+    config.glow_intensity = scenario.glow_intensity;
+    config.animation_speed = scenario.animation_speed;
+    config.enable_gradient = scenario.gradient;
+    
+    uint32_t features = config.features();
+    if (scenario.instanced) {
+        features |= GLOW_FEATURE_INSTANCED;
+    }
+    
+    glow_program_t program;
+    auto vertex_source = build_glow_vertex_source(features);
+    auto fragment_source = build_glow_fragment_source(features);
+    if (!program.compile_shaders(vertex_source.c_str(), fragment_source.c_str())) {
+        fprintf(stderr, "%s: %s\n", scenario.name, program.error_log.c_str());
+        program.destroy();
+        return false;
+    }
+    
+    atlas_t atlas;
+    if (scenario.atlas && !atlas.create(config, geometry, options)) {
+        atlas.destroy();
+        program.destroy();
+        return false;
+    }
+    
+    auto block = make_glow_config_block(config);
+    glBindBuffer(GL_UNIFORM_BUFFER, config_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    
+    auto windows = make_windows(scenario.windows, options.width, options.height);
+    const int warmup = std::min(options.frames, 10);
+    
+    result = {};
+    result.scenario = &scenario;
+    result.features = features;
+    uint64_t calls = 0, draws = 0, allocs = 0;
+    
+    for (int frame = -warmup; frame < options.frames; frame++) {
+        glClear(GL_COLOR_BUFFER_BIT);
+        
+        uint64_t calls_before = gl_calls, draws_before = draw_calls, allocs_before = allocations;
+        uint64_t uploads_before = program.uniform_uploads + atlas.sample_program.uniform_uploads;
+        uint64_t skipped_before = program.uniform_uploads_skipped +
+            atlas.sample_program.uniform_uploads_skipped;
+        auto start = std::chrono::steady_clock::now();
+        
+        float time = frame / 60.0f * config.animation_speed;
+        double fragments = 0.0;
+        std::vector<glow_instance_t> instances;
+        if (scenario.instanced) {
+            instances.reserve(windows.size());
+        }
+        
+        // Back to front, one draw per window unless batched, as in the plugin
+        for (size_t i = windows.size(); i-- > 0;) {
+            auto& w = windows[i];
+            auto ring = compute_glow_ring(w.x, w.y, w.width, w.height, config);
+            fragments += ring_fragments(ring, options.width, options.height);
+            
+            glm::vec4 color = (i == 0) ? config.active_color : config.inactive_color;
+            auto window = make_instance(w, color, config, time);
+            if (scenario.instanced) {
+                instances.push_back(window);
+                continue;
+            }
+            
+            bool sampled = atlas.can_sample(w, config);
+            auto& draw_program = sampled ? atlas.sample_program : program;
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            draw_program.use();
+            if (sampled) {
+                atlas.bind(config);
+            } else {
+                glBindBufferBase(GL_UNIFORM_BUFFER, GLOW_CONFIG_BINDING, config_ubo);
+            }
+            
+            draw_program.set_uniform(draw_program.u_resolution, options.width, options.height);
+            set_glow_window_uniforms(draw_program, ring, window);
+            
+            glBindVertexArray(geometry.vao);
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(0, 0, options.width, options.height);
+            glDrawElements(GL_TRIANGLES, GLOW_RING_INDEX_COUNT, GL_UNSIGNED_BYTE, nullptr);
+            glDisable(GL_SCISSOR_TEST);
+            glBindVertexArray(0);
+            if (sampled) {
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+        }
+        
+        if (scenario.instanced) {
+            geometry.upload_instances(instances);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            program.use();
+            glBindBufferBase(GL_UNIFORM_BUFFER, GLOW_CONFIG_BINDING, config_ubo);
+            program.set_uniform(program.u_resolution, options.width, options.height);
+            
+            glBindVertexArray(geometry.instanced_vao);
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(0, 0, options.width, options.height);
+            glDrawElementsInstanced(GL_TRIANGLES, GLOW_RING_INDEX_COUNT, GL_UNSIGNED_BYTE,
+                nullptr, static_cast<GLsizei>(instances.size()));
+            glDisable(GL_SCISSOR_TEST);
+            glBindVertexArray(0);
+        }
+        
+        instances = {};
+        auto submitted = std::chrono::steady_clock::now();
+        glFinish();
+        auto finished = std::chrono::steady_clock::now();
+        
+        if (frame < 0) {
+            continue;
+        }
+        
+        result.cpu_ms += std::chrono::duration<double, std::milli>(submitted - start).count();
+        result.frame_ms += std::chrono::duration<double, std::milli>(finished - start).count();
+        result.fragments += fragments;
+        result.uniform_uploads += program.uniform_uploads + atlas.sample_program.uniform_uploads -
+            uploads_before;
+        result.uniform_uploads_skipped += program.uniform_uploads_skipped +
+            atlas.sample_program.uniform_uploads_skipped - skipped_before;
+        calls += gl_calls - calls_before;
+        draws += draw_calls - draws_before;
+        allocs += allocations - allocs_before;
+    }
+    
+    double frames = std::max(options.frames, 1);
+    result.cpu_ms /= frames;
+    result.frame_ms /= frames;
+    result.fragments /= frames;
+    result.uniform_uploads /= frames;
+    result.uniform_uploads_skipped /= frames;
+    result.gl_calls = calls / frames;
+    result.draw_calls = draws / frames;
+    result.allocations = allocs / frames;
+    
+    program.destroy();
+    atlas.destroy();
+    return run_cpu_kernel(config, features, windows, options, geometry, config_ubo, result) &&
+        glGetError() == GL_NO_ERROR;
+}
+
+static void write_json(FILE *out, const options_t& options, const std::vector<result_t>& results) {
+    auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    fprintf(out, "{\n");
+    fprintf(out, "  \"renderer\": \"%s\",\n", renderer ? renderer : "unknown");
+    fprintf(out, "  \"cpu_kernel\": \"%s\",\n", glow_cpu_kernel_name());
+    fprintf(out, "  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n",
+        options.width, options.height, options.frames);
+    fprintf(out, "  \"scenarios\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"name\": \"%s\",\n", r.scenario->name);
+        fprintf(out, "      \"windows\": %d,\n", r.scenario->windows);
+        fprintf(out, "      \"features\": %u,\n", r.features);
+        fprintf(out, "      \"atlas\": %s,\n", r.scenario->atlas ? "true" : "false");
+        fprintf(out, "      \"fps\": %.2f,\n", r.frame_ms > 0.0 ? 1000.0 / r.frame_ms : 0.0);
+        fprintf(out, "      \"frame_ms\": %.4f,\n", r.frame_ms);
+        fprintf(out, "      \"cpu_ms_per_frame\": %.4f,\n", r.cpu_ms);
+        fprintf(out, "      \"fragments_per_frame\": %.0f,\n", r.fragments);
+        fprintf(out, "      \"gl_calls_per_frame\": %.2f,\n", r.gl_calls);
+        fprintf(out, "      \"draw_calls_per_frame\": %.2f,\n", r.draw_calls);
+        fprintf(out, "      \"uniform_uploads_per_frame\": %.2f,\n", r.uniform_uploads);
+        fprintf(out, "      \"uniform_uploads_skipped_per_frame\": %.2f,\n",
+            r.uniform_uploads_skipped);
+        fprintf(out, "      \"allocations_per_frame\": %.2f,\n", r.allocations);
+        fprintf(out, "      \"cpu_features\": %u,\n", r.features & GLOW_CPU_FEATURES);
+        fprintf(out, "      \"cpu_kernel_ms_per_frame\": %.4f,\n", r.cpu_kernel_ms);
+        fprintf(out, "      \"cpu_max_diff\": %d,\n", r.max_diff);
+        fprintf(out, "      \"cpu_mean_diff\": %.4f\n", r.mean_diff);
+        fprintf(out, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    options_t options;
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--frames") && has_value) {
+            options.frames = std::max(std::atoi(argv[++i]), 1);
+        } else if (!strcmp(argv[i], "--width") && has_value) {
+            options.width = std::max(std::atoi(argv[++i]), 1);
+        } else if (!strcmp(argv[i], "--height") && has_value) {
+            options.height = std::max(std::atoi(argv[++i]), 1);
+        } else if (!strcmp(argv[i], "--output") && has_value) {
+            options.output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--frames N] [--width W] [--height H] [--output FILE]\n",
+                argv[0]);
+            return 2;
+        }
+    }
+    
+    EGLDisplay display;
+    EGLContext context;
+    if (!init_context(display, context)) {
+        fprintf(stderr, "glow-bench: no surfaceless GLES 3 context\n");
+        return 1;
+    }
+    
+    // Offscreen target the size of an output
+    GLuint texture, framebuffer;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, options.width, options.height, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "glow-bench: offscreen framebuffer incomplete\n");
+        return 1;
+    }
+    
+    glViewport(0, 0, options.width, options.height);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    
+    glow_geometry_t geometry;
+    GLuint config_ubo;
+    glGenBuffers(1, &config_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, config_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(glow_config_block_t), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    if (!geometry.create()) {
+        fprintf(stderr, "glow-bench: failed to allocate vertex buffers\n");
+        return 1;
+    }
+    
+    bool ok = true;
+    std::vector<result_t> results;
+    for (auto& scenario : scenarios) {
+        result_t result;
+        if (run_scenario(scenario, options, geometry, config_ubo, result)) {
+            results.push_back(result);
+        } else {
+            fprintf(stderr, "glow-bench: scenario %s failed\n", scenario.name);
+            ok = false;
+        }
+    }
+    
+    FILE *out = options.output ? fopen(options.output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "glow-bench: cannot write %s\n", options.output);
+        return 1;
+    }
+    
+    write_json(out, options, results);
+    if (out != stdout) {
+        fclose(out);
+    }
+    
+    geometry.destroy();
+    glDeleteBuffers(1, &config_ubo);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &texture);
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    return ok ? 0 : 1;
+}
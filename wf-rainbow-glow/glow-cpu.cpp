@@ -0,0 +1,568 @@
+#include "glow-cpu.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace wf {
+namespace glow_decoration {
+
+namespace {
+
+/**
+ * Lane types. Each provides the same static operations on N floats, so the
+ * kernels below are written once and instantiated for the vector type of the
+ * build plus simd_scalar, which also handles the tail of every span.
+ */
+struct simd_scalar {
+    static constexpr int N = 1;
+    using f = float;
+    using m = bool;
+    
+    static f splat(float x) { return x; }
+    static f load(const float *p) { return *p; }
+    static void store(float *p, f x) { *p = x; }
+    static f ramp() { return 0.0f; }
+    static f add(f a, f b) { return a + b; }
+    static f sub(f a, f b) { return a - b; }
+    static f mul(f a, f b) { return a * b; }
+    static f min(f a, f b) { return std::min(a, b); }
+    static f max(f a, f b) { return std::max(a, b); }
+    static f sqrt(f a) { return std::sqrt(a); }
+    static f abs(f a) { return std::fabs(a); }
+    static f floor(f a) { return std::floor(a); }
+    static m gt(f a, f b) { return a > b; }
+    static m le(f a, f b) { return a <= b; }
+    static m lt(f a, f b) { return a < b; }
+    static m both(m a, m b) { return a && b; }
+    static f select(m mask, f a, f b) { return mask ? a : b; }
+    
+    // 2^n for a whole number n in [-126, 0]
+    static f exp2i(f n) {
+        uint32_t bits = static_cast<uint32_t>(static_cast<int>(n) + 127) << 23;
+        float out;
+        std::memcpy(&out, &bits, sizeof(out));
+        return out;
+    }
+    
+    static void unpack(const uint32_t *p, f& b, f& g, f& r, f& a) {
+        b = *p & 0xff;
+        g = (*p >> 8) & 0xff;
+        r = (*p >> 16) & 0xff;
+        a = *p >> 24;
+    }
+    
+    // Channels already clamped to 0..255
+    static void pack(uint32_t *p, f b, f g, f r, f a) {
+        *p = uint32_t(std::lrint(b)) | uint32_t(std::lrint(g)) << 8 |
+            uint32_t(std::lrint(r)) << 16 | uint32_t(std::lrint(a)) << 24;
+    }
+};
+
+#if defined(__AVX2__)
+struct simd_avx2 {
+    static constexpr int N = 8;
+    using f = __m256;
+    using m = __m256;
+    
+    static f splat(float x) { return _mm256_set1_ps(x); }
+    static f load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, f x) { _mm256_storeu_ps(p, x); }
+    static f ramp() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+    static f add(f a, f b) { return _mm256_add_ps(a, b); }
+    static f sub(f a, f b) { return _mm256_sub_ps(a, b); }
+    static f mul(f a, f b) { return _mm256_mul_ps(a, b); }
+    static f min(f a, f b) { return _mm256_min_ps(a, b); }
+    static f max(f a, f b) { return _mm256_max_ps(a, b); }
+    static f sqrt(f a) { return _mm256_sqrt_ps(a); }
+    static f abs(f a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static f floor(f a) { return _mm256_floor_ps(a); }
+    static m gt(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static m le(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static m lt(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static m both(m a, m b) { return _mm256_and_ps(a, b); }
+    static f select(m mask, f a, f b) { return _mm256_blendv_ps(b, a, mask); }
+    
+    static f exp2i(f n) {
+        __m256i bits = _mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(bits, 23));
+    }
+    
+    static void unpack(const uint32_t *p, f& b, f& g, f& r, f& a) {
+        __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i mask = _mm256_set1_epi32(0xff);
+        b = _mm256_cvtepi32_ps(_mm256_and_si256(px, mask));
+        g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask));
+        r = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask));
+        a = _mm256_cvtepi32_ps(_mm256_srli_epi32(px, 24));
+    }
+    
+    static void pack(uint32_t *p, f b, f g, f r, f a) {
+        __m256i px = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cvtps_epi32(b), _mm256_slli_epi32(_mm256_cvtps_epi32(g), 8)),
+            _mm256_or_si256(_mm256_slli_epi32(_mm256_cvtps_epi32(r), 16),
+                _mm256_slli_epi32(_mm256_cvtps_epi32(a), 24)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), px);
+    }
+};
+
+using simd = simd_avx2;
+#elif defined(__SSE2__)
+struct simd_sse2 {
+    static constexpr int N = 4;
+    using f = __m128;
+    using m = __m128;
+    
+    static f splat(float x) { return _mm_set1_ps(x); }
+    static f load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, f x) { _mm_storeu_ps(p, x); }
+    static f ramp() { return _mm_setr_ps(0, 1, 2, 3); }
+    static f add(f a, f b) { return _mm_add_ps(a, b); }
+    static f sub(f a, f b) { return _mm_sub_ps(a, b); }
+    static f mul(f a, f b) { return _mm_mul_ps(a, b); }
+    static f min(f a, f b) { return _mm_min_ps(a, b); }
+    static f max(f a, f b) { return _mm_max_ps(a, b); }
+    static f sqrt(f a) { return _mm_sqrt_ps(a); }
+    static f abs(f a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static m gt(f a, f b) { return _mm_cmpgt_ps(a, b); }
+    static m le(f a, f b) { return _mm_cmple_ps(a, b); }
+    static m lt(f a, f b) { return _mm_cmplt_ps(a, b); }
+    static m both(m a, m b) { return _mm_and_ps(a, b); }
+    static f select(m mask, f a, f b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    
+    // No rounding instructions before SSE4.1: truncate, then step down for negatives
+    static f floor(f a) {
+        f t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+    }
+    
+    static f exp2i(f n) {
+        __m128i bits = _mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127));
+        return _mm_castsi128_ps(_mm_slli_epi32(bits, 23));
+    }
+    
+    static void unpack(const uint32_t *p, f& b, f& g, f& r, f& a) {
+        __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i mask = _mm_set1_epi32(0xff);
+        b = _mm_cvtepi32_ps(_mm_and_si128(px, mask));
+        g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+        r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+        a = _mm_cvtepi32_ps(_mm_srli_epi32(px, 24));
+    }
+    
+    static void pack(uint32_t *p, f b, f g, f r, f a) {
+        __m128i px = _mm_or_si128(
+            _mm_or_si128(_mm_cvtps_epi32(b), _mm_slli_epi32(_mm_cvtps_epi32(g), 8)),
+            _mm_or_si128(_mm_slli_epi32(_mm_cvtps_epi32(r), 16),
+                _mm_slli_epi32(_mm_cvtps_epi32(a), 24)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), px);
+    }
+};
+
+using simd = simd_sse2;
+#elif defined(__aarch64__)
+struct simd_neon {
+    static constexpr int N = 4;
+    using f = float32x4_t;
+    using m = uint32x4_t;
+    
+    static f splat(float x) { return vdupq_n_f32(x); }
+    static f load(const float *p) { return vld1q_f32(p); }
+    static void store(float *p, f x) { vst1q_f32(p, x); }
+    static f ramp() { static const float r[4] = {0, 1, 2, 3}; return vld1q_f32(r); }
+    static f add(f a, f b) { return vaddq_f32(a, b); }
+    static f sub(f a, f b) { return vsubq_f32(a, b); }
+    static f mul(f a, f b) { return vmulq_f32(a, b); }
+    static f min(f a, f b) { return vminq_f32(a, b); }
+    static f max(f a, f b) { return vmaxq_f32(a, b); }
+    static f sqrt(f a) { return vsqrtq_f32(a); }
+    static f abs(f a) { return vabsq_f32(a); }
+    static f floor(f a) { return vrndmq_f32(a); }
+    static m gt(f a, f b) { return vcgtq_f32(a, b); }
+    static m le(f a, f b) { return vcleq_f32(a, b); }
+    static m lt(f a, f b) { return vcltq_f32(a, b); }
+    static m both(m a, m b) { return vandq_u32(a, b); }
+    static f select(m mask, f a, f b) { return vbslq_f32(mask, a, b); }
+    
+    static f exp2i(f n) {
+        int32x4_t bits = vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127));
+        return vreinterpretq_f32_s32(vshlq_n_s32(bits, 23));
+    }
+    
+    static void unpack(const uint32_t *p, f& b, f& g, f& r, f& a) {
+        uint32x4_t px = vld1q_u32(p);
+        uint32x4_t mask = vdupq_n_u32(0xff);
+        b = vcvtq_f32_u32(vandq_u32(px, mask));
+        g = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(px, 8), mask));
+        r = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(px, 16), mask));
+        a = vcvtq_f32_u32(vshrq_n_u32(px, 24));
+    }
+    
+    static void pack(uint32_t *p, f b, f g, f r, f a) {
+        uint32x4_t px = vorrq_u32(
+            vorrq_u32(vcvtnq_u32_f32(b), vshlq_n_u32(vcvtnq_u32_f32(g), 8)),
+            vorrq_u32(vshlq_n_u32(vcvtnq_u32_f32(r), 16), vshlq_n_u32(vcvtnq_u32_f32(a), 24)));
+        vst1q_u32(p, px);
+    }
+};
+
+using simd = simd_neon;
+#else
+using simd = simd_scalar;
+#endif
+
+// Window values of one glow draw, in the terms of the fragment shader
+struct glow_shape_t {
+    float half_x, half_y;
+    float corner_r;
+    float border_width;
+    float glow_radius;
+    bool border_only;
+};
+
+// Colour and gain of one glow draw; the gradient position is linear along a row
+struct glow_paint_t {
+    float color[4];      // r, g, b, a at gradient position 0
+    float color_step[4]; // change up to gradient position 1
+    float gradient_step; // per pixel to the right
+    float gain;
+};
+
+// e^x for x <= 0, from 2^x split into a whole power and a polynomial
+template<class S>
+typename S::f exp_negative(typename S::f x) {
+    using f = typename S::f;
+    f y = S::max(S::min(S::mul(x, S::splat(1.442695041f)), S::splat(0.0f)), S::splat(-126.0f));
+    f n = S::floor(y);
+    f t = S::sub(y, n);
+    f p = S::splat(0.0013333558f);
+    p = S::add(S::mul(p, t), S::splat(0.0096181291f));
+    p = S::add(S::mul(p, t), S::splat(0.0555041087f));
+    p = S::add(S::mul(p, t), S::splat(0.2402265070f));
+    p = S::add(S::mul(p, t), S::splat(0.6931471806f));
+    p = S::add(S::mul(p, t), S::splat(1.0f));
+    return S::mul(p, S::exp2i(n));
+}
+
+// Border coverage and falloff of S::N pixels from x (window-centre relative) on row y
+template<class S>
+void eval_block(float x, float y, const glow_shape_t& shape, float *border, float *falloff) {
+    using f = typename S::f;
+    f zero = S::splat(0.0f);
+    f px = S::add(S::splat(x), S::ramp());
+    f qx = S::add(S::sub(S::abs(px), S::splat(shape.half_x)), S::splat(shape.corner_r));
+    f qy = S::splat(std::fabs(y) - shape.half_y + shape.corner_r);
+    f ox = S::max(qx, zero);
+    f oy = S::max(qy, zero);
+    f dist = S::add(S::min(S::max(qx, qy), zero),
+        S::sub(S::sqrt(S::add(S::mul(ox, ox), S::mul(oy, oy))), S::splat(shape.corner_r)));
+    
+    auto in_border = S::both(S::gt(dist, S::splat(-shape.border_width)), S::le(dist, zero));
+    S::store(border, S::select(in_border, S::splat(1.0f), zero));
+    if (shape.border_only) {
+        S::store(falloff, zero);
+        return;
+    }
+    
+    auto in_glow = S::both(S::gt(dist, zero), S::lt(dist, S::splat(shape.glow_radius)));
+    f value = exp_negative<S>(S::mul(dist, S::splat(-3.0f / shape.glow_radius)));
+    S::store(falloff, S::select(in_glow, value, zero));
+}
+
+// Blends S::N pixels given their border coverage and falloff
+template<class S>
+void blend_block(uint32_t *dst, typename S::f border, typename S::f falloff,
+    float gradient_pos, const glow_paint_t& paint) {
+    using f = typename S::f;
+    f zero = S::splat(0.0f);
+    f one = S::splat(1.0f);
+    auto is_border = S::gt(border, zero);
+    
+    // Same discard threshold as the shader
+    f factor = S::select(is_border, one, S::mul(falloff, S::splat(paint.gain)));
+    factor = S::select(S::gt(factor, S::splat(0.001f)), factor, zero);
+    f bloom = S::select(is_border, S::splat(1.2f), one);
+    
+    f pos = S::add(S::splat(gradient_pos), S::mul(S::ramp(), S::splat(paint.gradient_step)));
+    pos = S::min(S::max(pos, zero), one);
+    
+    // Fixed-point targets clamp the source to [0, 1] before blending
+    f alpha = S::mul(S::add(S::splat(paint.color[3]), S::mul(S::splat(paint.color_step[3]), pos)),
+        factor);
+    f rgb_scale = S::mul(S::mul(alpha, bloom), S::splat(255.0f));
+    alpha = S::min(alpha, one);
+    f keep = S::sub(one, alpha);
+    
+    f d[4];
+    S::unpack(dst, d[2], d[1], d[0], d[3]);
+    f out[4];
+    for (int c = 0; c < 3; c++) {
+        f color = S::add(S::splat(paint.color[c]), S::mul(S::splat(paint.color_step[c]), pos));
+        f src = S::min(S::mul(color, rgb_scale), S::splat(255.0f));
+        out[c] = S::min(S::add(src, S::mul(d[c], keep)), S::splat(255.0f));
+    }
+    
+    out[3] = S::min(S::add(S::mul(alpha, S::splat(255.0f)), S::mul(d[3], keep)), S::splat(255.0f));
+    S::pack(dst, out[2], out[1], out[0], out[3]);
+}
+
+void eval_span(float x, float y, const glow_shape_t& shape, int n, float *border, float *falloff) {
+    int i = 0;
+    for (; i + simd::N <= n; i += simd::N) {
+        eval_block<simd>(x + i, y, shape, border + i, falloff + i);
+    }
+    
+    for (; i < n; i++) {
+        eval_block<simd_scalar>(x + i, y, shape, border + i, falloff + i);
+    }
+}
+
+void blend_span(uint32_t *dst, int n, const float *border, const float *falloff,
+    float gradient_pos, const glow_paint_t& paint) {
+    int i = 0;
+    for (; i + simd::N <= n; i += simd::N) {
+        blend_block<simd>(dst + i, simd::load(border + i), simd::load(falloff + i),
+            gradient_pos + i * paint.gradient_step, paint);
+    }
+    
+    for (; i < n; i++) {
+        blend_block<simd_scalar>(dst + i, border[i], falloff[i],
+            gradient_pos + i * paint.gradient_step, paint);
+    }
+}
+
+// Straight stretch of the top or bottom glow: one value for the whole span
+void blend_span(uint32_t *dst, int n, float border, float falloff,
+    float gradient_pos, const glow_paint_t& paint) {
+    int i = 0;
+    for (; i + simd::N <= n; i += simd::N) {
+        blend_block<simd>(dst + i, simd::splat(border), simd::splat(falloff),
+            gradient_pos + i * paint.gradient_step, paint);
+    }
+    
+    for (; i < n; i++) {
+        blend_block<simd_scalar>(dst + i, border, falloff,
+            gradient_pos + i * paint.gradient_step, paint);
+    }
+}
+
+} // namespace
+
+const char *glow_cpu_kernel_name() {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#elif defined(__aarch64__)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+bool glow_cpu_renderer_t::profile_key_t::operator<(const profile_key_t& other) const {
+    return std::tie(glow_radius, border_width, corner_radius, border_only) <
+        std::tie(other.glow_radius, other.border_width, other.corner_radius, other.border_only);
+}
+
+const glow_cpu_renderer_t::profile_t& glow_cpu_renderer_t::get_profile(const profile_key_t& key) {
+    auto it = profiles.find(key);
+    if (it != profiles.end()) {
+        return it->second;
+    }
+    
+    // Shapes change only with the configuration; start over rather than grow
+    if (profiles.size() >= 16) {
+        profiles.clear();
+    }
+    
+    profile_t profile;
+    profile.glow = static_cast<int>(std::ceil(key.glow_radius));
+    profile.inset = static_cast<int>(std::ceil(key.border_width + key.corner_radius));
+    profile.size = profile.glow + profile.inset;
+    int size = profile.size;
+    
+    // A window large enough that the tile never reaches its centre lines;
+    // tile pixel (u, v) lies glow - u / glow - v outside its top-left edges
+    glow_shape_t shape;
+    shape.half_x = shape.half_y = size + 1.0f;
+    shape.corner_r = key.corner_radius;
+    shape.border_width = key.border_width;
+    shape.glow_radius = key.glow_radius;
+    shape.border_only = key.border_only;
+    float x0 = -shape.half_x - profile.glow + 0.5f;
+    
+    profile.tile_border.resize(size * size);
+    profile.tile_falloff.resize(size * size);
+    for (int v = 0; v < size; v++) {
+        float y = -shape.half_y - profile.glow + v + 0.5f;
+        eval_span(x0, y, shape, size, &profile.tile_border[v * size], &profile.tile_falloff[v * size]);
+    }
+    
+    // Straight edges: rows through the window centre
+    profile.edge_border.resize(size);
+    profile.edge_falloff.resize(size);
+    eval_span(x0, 0.0f, shape, size, profile.edge_border.data(), profile.edge_falloff.data());
+    
+    auto mirror = [size] (const std::vector<float>& in, int rows) {
+        std::vector<float> out(in.size());
+        for (int v = 0; v < rows; v++) {
+            std::reverse_copy(in.begin() + v * size, in.begin() + (v + 1) * size,
+                out.begin() + v * size);
+        }
+        
+        return out;
+    };
+    
+    profile.mirrored_border = mirror(profile.tile_border, size);
+    profile.mirrored_falloff = mirror(profile.tile_falloff, size);
+    profile.mirrored_edge_border = mirror(profile.edge_border, 1);
+    profile.mirrored_edge_falloff = mirror(profile.edge_falloff, 1);
+    return profiles[key] = std::move(profile);
+}
+
+void glow_cpu_renderer_t::clear_cache() {
+    profiles.clear();
+}
+
+void glow_cpu_renderer_t::draw(const glow_cpu_target_t& target, const glow_cpu_clip_t& clip,
+    const glow_config_t& config, uint32_t features, const glow_instance_t& window) {
+    float box_x = window.border_box[0], box_y = window.border_box[1];
+    float box_w = window.border_box[2], box_h = window.border_box[3];
+    if (box_w <= 0.0f || box_h <= 0.0f) {
+        return;
+    }
+    
+    glow_shape_t shape;
+    shape.half_x = box_w * 0.5f;
+    shape.half_y = box_h * 0.5f;
+    shape.corner_r = (features & GLOW_FEATURE_ROUNDED) ?
+        std::min(config.corner_radius, std::min(shape.half_x, shape.half_y)) : 0.0f;
+    shape.border_width = config.border_width;
+    shape.glow_radius = config.glow_radius;
+    shape.border_only = (features & GLOW_FEATURE_BORDER_ONLY) != 0;
+    float center_x = box_x + shape.half_x;
+    float center_y = box_y + shape.half_y;
+    
+    glow_paint_t paint;
+    float gradient_x = 0.0f, gradient_y = 0.0f;
+    for (int c = 0; c < 4; c++) {
+        paint.color[c] = window.glow_color[c];
+        paint.color_step[c] = 0.0f;
+    }
+    
+    if (features & GLOW_FEATURE_GRADIENT) {
+        float angle = config.gradient_angle * float(M_PI) / 180.0f;
+        gradient_x = std::cos(angle) / shape.half_x * 0.5f;
+        gradient_y = -std::sin(angle) / shape.half_y * 0.5f;
+        for (int c = 0; c < 4; c++) {
+            paint.color_step[c] = window.glow_color_2[c] - window.glow_color[c];
+        }
+    }
+    
+    paint.gradient_step = gradient_x;
+    paint.gain = config.glow_intensity;
+    if (features & GLOW_FEATURE_PULSE) {
+        paint.gain *= 1.0f + std::sin(window.time * 2.0f) * 0.05f;
+    }
+    
+    int x1 = std::max(clip.x1, 0), x2 = std::min(clip.x2, target.width);
+    int y1 = std::max(clip.y1, 0), y2 = std::min(clip.y2, target.height);
+    
+    // Blends the pixels [x, x + n) of row y whose values start at the given offset
+    auto blend = [&] (int y, int x, int n, auto border, auto falloff) {
+        int skip = std::max(x1 - x, 0);
+        n = std::min(x + n, x2) - x - skip;
+        if (n <= 0) {
+            return;
+        }
+        
+        x += skip;
+        float gradient_pos = ((x + 0.5f - center_x) * gradient_x + (y + 0.5f - center_y) * gradient_y) +
+            0.5f;
+        if constexpr (std::is_pointer_v<decltype(border)>) {
+            border += skip;
+            falloff += skip;
+        }
+        
+        blend_span(target.pixels + size_t(y) * target.stride + x, n, border, falloff,
+            gradient_pos, paint);
+    };
+    
+    // Windows on whole pixels with unclamped corners reuse the shape profile
+    bool whole_pixels = box_x == std::floor(box_x) && box_y == std::floor(box_y) &&
+        box_w == std::floor(box_w) && box_h == std::floor(box_h);
+    int inset = static_cast<int>(std::ceil(shape.border_width + shape.corner_r));
+    bool unclamped = !(features & GLOW_FEATURE_ROUNDED) || shape.corner_r == config.corner_radius;
+    if (whole_pixels && unclamped && box_w >= 2 * inset && box_h >= 2 * inset) {
+        auto& profile = get_profile({shape.border_only ? 0.0f : shape.glow_radius,
+            shape.border_width, shape.corner_r, shape.border_only});
+        int left = static_cast<int>(box_x), top = static_cast<int>(box_y);
+        int width = static_cast<int>(box_w), height = static_cast<int>(box_h);
+        int glow = profile.glow, size = profile.size;
+        
+        for (int y = std::max(top - glow, y1); y < std::min(top + height + glow, y2); y++) {
+            // Rows mirror about the centre, as do columns
+            int v = std::min(y - top, top + height - 1 - y) + glow;
+            if (v >= size) {
+                // Straight stretch of the left and right edges only
+                blend(y, left - glow, size, profile.edge_border.data(), profile.edge_falloff.data());
+                blend(y, left + width - profile.inset, size, profile.mirrored_edge_border.data(),
+                    profile.mirrored_edge_falloff.data());
+                continue;
+            }
+            
+            blend(y, left - glow, size, &profile.tile_border[v * size], &profile.tile_falloff[v * size]);
+            blend(y, left + profile.inset, width - 2 * profile.inset, profile.edge_border[v],
+                profile.edge_falloff[v]);
+            blend(y, left + width - profile.inset, size, &profile.mirrored_border[v * size],
+                &profile.mirrored_falloff[v * size]);
+        }
+        
+        return;
+    }
+    
+    // Anything else evaluates the SDF over the ring spans of compute_glow_ring()
+    auto ring = compute_glow_ring(box_x, box_y, box_w, box_h, config, shape.border_only);
+    auto first_pixel = [] (float edge) {
+        return static_cast<int>(std::ceil(edge - 0.5f));
+    };
+    
+    int span_x[4], span_y[4];
+    for (int i = 0; i < 4; i++) {
+        span_x[i] = first_pixel(ring.x[i]);
+        span_y[i] = first_pixel(ring.y[i]);
+    }
+    
+    row_border.resize(span_x[3] - span_x[0]);
+    row_falloff.resize(span_x[3] - span_x[0]);
+    for (int y = std::max(span_y[0], y1); y < std::min(span_y[3], y2); y++) {
+        auto eval_and_blend = [&] (int from, int to) {
+            from = std::max(from, x1);
+            to = std::min(to, x2);
+            if (to > from) {
+                eval_span(from + 0.5f - center_x, y + 0.5f - center_y, shape, to - from,
+                    row_border.data(), row_falloff.data());
+                blend(y, from, to - from, row_border.data(), row_falloff.data());
+            }
+        };
+        
+        if (y >= span_y[1] && y < span_y[2]) {
+            eval_and_blend(span_x[0], span_x[1]);
+            eval_and_blend(span_x[2], span_x[3]);
+        } else {
+            eval_and_blend(span_x[0], span_x[3]);
+        }
+    }
+}
+
+} // namespace glow_decoration
+} // namespace wf
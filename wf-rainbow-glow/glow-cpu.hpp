@@ -0,0 +1,89 @@
+#pragma once
+
+/**
+ * CPU implementation of the glow shader, for targets without GLES and as a
+ * reference for the GLSL output. It blends premultiplied pixels straight into
+ * a memory buffer, evaluates only the ring spans around a window, and keeps
+ * the corner and edge profiles of each glow shape, so most windows never
+ * evaluate the SDF at all. The kernels use AVX2, SSE2 or NEON when the build
+ * targets them and plain C++ otherwise.
+ */
+
+#include "glow-render.hpp"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace wf {
+namespace glow_decoration {
+
+// Shader features the CPU kernel reproduces; wobble and edge noise are not
+// drawn, so callers reduce those looks the way the quality governor does
+constexpr uint32_t GLOW_CPU_FEATURES = GLOW_FEATURE_GRADIENT | GLOW_FEATURE_PULSE |
+    GLOW_FEATURE_ROUNDED | GLOW_FEATURE_BORDER_ONLY;
+
+// Premultiplied 0xAARRGGBB pixels in native byte order (pixman a8r8g8b8)
+struct glow_cpu_target_t {
+    uint32_t *pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;  // in pixels
+};
+
+// Pixel rectangle [x1, x2) x [y1, y2) drawing is restricted to
+struct glow_cpu_clip_t {
+    int x1, y1, x2, y2;
+};
+
+// Instruction set the kernels were built for: "avx2", "sse2", "neon" or "scalar"
+const char *glow_cpu_kernel_name();
+
+class glow_cpu_renderer_t {
+  public:
+    /**
+     * Blends the glow of one window over the target, matching the shader
+     * variant for features & GLOW_CPU_FEATURES. The window values are those
+     * of an instanced draw, relative to the target.
+     */
+    void draw(const glow_cpu_target_t& target, const glow_cpu_clip_t& clip,
+        const glow_config_t& config, uint32_t features, const glow_instance_t& window);
+    
+    void clear_cache();
+    
+  private:
+    // Everything the border and falloff coverage of a corner depends on
+    struct profile_key_t {
+        float glow_radius;
+        float border_width;
+        float corner_radius;
+        bool border_only;
+        
+        bool operator<(const profile_key_t& other) const;
+    };
+    
+    /**
+     * Border (0/1) and bare exp() falloff of the top-left corner of a window,
+     * for pixels -glow..inset-1 away from its edges, in size x size tiles;
+     * plus the straight edge profile, and both mirrored for the right side.
+     */
+    struct profile_t {
+        int glow = 0;
+        int inset = 0;
+        int size = 0;
+        std::vector<float> tile_border, tile_falloff;
+        std::vector<float> mirrored_border, mirrored_falloff;
+        std::vector<float> edge_border, edge_falloff;
+        std::vector<float> mirrored_edge_border, mirrored_edge_falloff;
+    };
+    
+    std::map<profile_key_t, profile_t> profiles;
+    
+    // Scratch rows for windows drawn without a profile
+    std::vector<float> row_border, row_falloff;
+    
+    const profile_t& get_profile(const profile_key_t& key);
+};
+
+} // namespace glow_decoration
+} // namespace wf
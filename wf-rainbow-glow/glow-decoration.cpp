@@ -10,137 +10,1329 @@
 #include <wayfire/scene.hpp>
 #include <wayfire/scene-render.hpp>
 #include <wayfire/scene-operations.hpp>
+#include <wayfire/opengl.hpp>
+#include <GLES2/gl2ext.h>
+#include <algorithm>
+#include <any>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
 #include <chrono>
 
 namespace wf {
 namespace glow_decoration {
 
-glow_program_t g_glow_program;
-glow_config_t g_config;
-static std::chrono::steady_clock::time_point g_start_time = std::chrono::steady_clock::now();
+// Baked glow atlas
+bool glow_texture_cache_t::create_resources() {
+    if (texture) return true;
+    if (broken) return false;
+    
+    if (!program_cache->build(bake_program, glow_bake_vertex_shader, glow_bake_fragment_shader) ||
+        !program_cache->build(sample_program, glow_vertex_shader, glow_cached_fragment_shader)) {
+        LOGE("Glow decoration: ", bake_program.error_log, sample_program.error_log);
+        LOGE("Glow decoration: atlas shaders failed, using analytic glow only");
+        broken = true;
+        return false;
+    }
+    
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, ATLAS_SIZE, ATLAS_SIZE, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    GLint prev_fb;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fb);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, prev_fb);
+    
+    if (!complete) {
+        LOGE("Glow decoration: atlas framebuffer incomplete, using analytic glow only");
+        destroy();
+        broken = true;
+        return false;
+    }
+    
+    return true;
+}
+
+bool glow_texture_cache_t::allocate(int size, glow_atlas_entry_t& entry) {
+    // Shelf packing with a 1 texel gap so linear filtering never bleeds between entries
+    int w = size + 1;
+    int h = size + 2;
+    if (w > ATLAS_SIZE || h > ATLAS_SIZE) return false;
+    
+    if (shelf_x + w > ATLAS_SIZE) {
+        shelf_x = 0;
+        shelf_y += shelf_height;
+        shelf_height = 0;
+    }
+    
+    if (shelf_y + h > ATLAS_SIZE) {
+        // Full: start over, live shapes get re-baked on their next lookup
+        invalidate();
+    }
+    
+    entry.x = shelf_x;
+    entry.y = shelf_y;
+    entry.size = size;
+    shelf_x += w;
+    shelf_height = std::max(shelf_height, h);
+    return true;
+}
 
-// Shader compilation
-bool glow_program_t::compile_shader(GLuint shader, const char* source) {
-    glShaderSource(shader, 1, &source, nullptr);
-    glCompileShader(shader);
+void glow_texture_cache_t::bake(const glow_atlas_key_t& key, const glow_atlas_entry_t& entry,
+    const glow_geometry_t& geometry) {
+    GLint prev_fb;
+    GLint prev_viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fb);
+    glGetIntegerv(GL_VIEWPORT, prev_viewport);
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(entry.x, entry.y, entry.size, entry.size + 1);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_BLEND);
+    
+    bake_program.use();
+    bake_program.set_uniform(bake_program.u_tile_origin, entry.x, entry.y);
+    bake_program.set_uniform(bake_program.u_glow_radius, key.glow_radius);
+    bake_program.set_uniform(bake_program.u_border_width, key.border_width);
+    bake_program.set_uniform(bake_program.u_corner_radius, key.corner_radius);
     
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    // The bake shader builds its quad from gl_VertexID
+    glBindVertexArray(geometry.vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
     
-    if (!success) {
-        char log[1024];
-        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
-        LOGE("Glow shader compile error: ", log);
+    glBindFramebuffer(GL_FRAMEBUFFER, prev_fb);
+    glViewport(prev_viewport[0], prev_viewport[1], prev_viewport[2], prev_viewport[3]);
+    if (scissor) glEnable(GL_SCISSOR_TEST);
+    if (blend) glEnable(GL_BLEND);
+}
+
+const glow_atlas_entry_t* glow_texture_cache_t::lookup(const glow_config_t& config,
+    const wf::geometry_t& view_box, const glow_geometry_t& geometry) {
+    // The corner must not be clamped by the window size, see compute_glow_ring()
+    float inset = config.border_width + config.corner_radius;
+    if (std::min(view_box.width, view_box.height) < 2.0f * inset) {
+        return nullptr;
+    }
+    
+    glow_atlas_key_t key{config.glow_radius, config.border_width, config.corner_radius};
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        return &it->second;
+    }
+    
+    if (!create_resources()) {
+        return nullptr;
+    }
+    
+    glow_atlas_entry_t entry;
+    int size = static_cast<int>(std::ceil(config.glow_radius + inset));
+    if (!allocate(size, entry)) {
+        return nullptr;
+    }
+    
+    bake(key, entry, geometry);
+    return &(entries[key] = entry);
+}
+
+void glow_texture_cache_t::invalidate() {
+    entries.clear();
+    shelf_x = shelf_y = shelf_height = 0;
+}
+
+void glow_texture_cache_t::destroy() {
+    invalidate();
+    bake_program.destroy();
+    sample_program.destroy();
+    if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+    if (texture) glDeleteTextures(1, &texture);
+    framebuffer = texture = 0;
+}
+
+// Half-resolution falloff target
+bool glow_half_res_buffer_t::ensure(int min_width, int min_height) {
+    if (texture && min_width <= width && min_height <= height) {
+        return true;
+    }
+    
+    destroy();
+    width = min_width;
+    height = min_height;
+    
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    GLint prev_fb;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fb);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, prev_fb);
+    
+    if (!complete) {
+        LOGE("Glow decoration: half-resolution framebuffer incomplete");
+        destroy();
         return false;
     }
+    
     return true;
 }
 
-bool glow_program_t::link_program() {
-    glLinkProgram(program);
+void glow_half_res_buffer_t::destroy() {
+    if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+    if (texture) glDeleteTextures(1, &texture);
+    framebuffer = texture = 0;
+    width = height = 0;
+}
+
+// Quality governor
+void glow_governor_t::begin_draw(wf::output_t *output) {
+    // Draws for no particular output (e.g. offscreen captures) are not charged
+    if (!output) {
+        return;
+    }
+    
+    measuring = true;
+    draw_output = output;
+    outputs[output].frame_draws++;
+    draw_start = std::chrono::steady_clock::now();
+    
+    if (!gpu_timer_checked) {
+        gpu_timer_checked = true;
+        auto extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+        gpu_timer = extensions && std::strstr(extensions, "GL_EXT_disjoint_timer_query");
+    }
+    
+    if (!gpu_timer) {
+        return;
+    }
+    
+    collect_gpu_times();
+    if (pending_queries.size() >= GLOW_MAX_PENDING_QUERIES) {
+        return;
+    }
+    
+    if (free_queries.empty()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        free_queries.push_back(query);
+    }
+    
+    active_query = free_queries.back();
+    free_queries.pop_back();
+    glBeginQuery(GL_TIME_ELAPSED_EXT, active_query);
+}
+
+void glow_governor_t::end_draw() {
+    if (!measuring) {
+        return;
+    }
+    
+    if (active_query) {
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+        pending_queries.push_back({active_query, draw_output});
+        active_query = 0;
+    }
+    
+    auto elapsed = std::chrono::steady_clock::now() - draw_start;
+    outputs[draw_output].cpu_ms += std::chrono::duration<double, std::milli>(elapsed).count();
+    measuring = false;
+}
+
+void glow_governor_t::collect_gpu_times() {
+    // Results arrive a frame or two late; never wait for them
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    
+    size_t done = 0;
+    for (; done < pending_queries.size(); done++) {
+        auto& pending = pending_queries[done];
+        GLuint available = 0;
+        glGetQueryObjectuiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        
+        GLuint elapsed_ns = 0;
+        glGetQueryObjectuiv(pending.query, GL_QUERY_RESULT, &elapsed_ns);
+        auto it = outputs.find(pending.output);
+        if (!disjoint && it != outputs.end()) {
+            it->second.gpu_ms += elapsed_ns / 1e6;
+            it->second.timed_draws++;
+        }
+        
+        free_queries.push_back(pending.query);
+    }
+    
+    pending_queries.erase(pending_queries.begin(), pending_queries.begin() + done);
+}
+
+bool glow_governor_t::set_tier(int new_tier) {
+    for (auto& [output, cost] : outputs) {
+        cost.frames_over = cost.frames_under = 0;
+    }
+    
+    if (tier == new_tier) {
+        return false;
+    }
+    
+    tier = new_tier;
+    return true;
+}
+
+bool glow_governor_t::frame_done(wf::output_t *output, float budget_ms,
+    const glow_config_t& config) {
+    auto& frame = outputs[output];
+    
+    // Results arrive late and not every draw gets a query, so the GPU side
+    // is the mean time of the latest results times the draws of this frame
+    if (frame.timed_draws > 0) {
+        frame.gpu_ms_per_draw = frame.gpu_ms / frame.timed_draws;
+    }
+    
+    double cost = (frame.cpu_ms + frame.gpu_ms_per_draw * frame.frame_draws) / budget_ms * 100.0;
+    frame.cpu_ms = frame.gpu_ms = 0.0;
+    frame.frame_draws = frame.timed_draws = 0;
+    
+    int lowest = std::clamp(config.lowest_quality_tier, int(GLOW_TIER_FULL), int(GLOW_TIER_STATIC));
+    if (tier > lowest) {
+        return set_tier(lowest);
+    }
+    
+    // Sustained pressure steps down, sustained headroom steps back up; the
+    // gap between the two budgets keeps the tier from oscillating
+    frame.over_budget = cost > config.quality_budget_high;
+    if (frame.over_budget) {
+        frame.frames_under = 0;
+        if (++frame.frames_over >= config.quality_downgrade_frames && tier < lowest) {
+            return set_tier(tier + 1);
+        }
+    } else if (cost < config.quality_budget_low) {
+        frame.frames_over = 0;
+        bool others_over = std::any_of(outputs.begin(), outputs.end(), [] (auto& entry) {
+            return entry.second.over_budget;
+        });
+        if (++frame.frames_under >= config.quality_upgrade_frames && !others_over &&
+            tier > GLOW_TIER_FULL) {
+            return set_tier(tier - 1);
+        }
+    } else {
+        frame.frames_over = frame.frames_under = 0;
+    }
+    
+    return false;
+}
+
+void glow_governor_t::remove_output(wf::output_t *output) {
+    outputs.erase(output);
+    for (auto& pending : pending_queries) {
+        if (pending.output == output) {
+            pending.output = nullptr;
+        }
+    }
+}
+
+void glow_governor_t::reset() {
+    tier = GLOW_TIER_FULL;
+    outputs.clear();
+}
+
+void glow_governor_t::destroy() {
+    for (auto& pending : pending_queries) {
+        free_queries.push_back(pending.query);
+    }
+    
+    if (!free_queries.empty()) {
+        glDeleteQueries(free_queries.size(), free_queries.data());
+    }
+    
+    free_queries.clear();
+    pending_queries.clear();
+    gpu_timer_checked = false;
+}
+
+// Shared runtime
+glow_runtime_t::glow_runtime_t() : start_time(std::chrono::steady_clock::now()) {
+    load_config();
+    
+    auto cache_home = getenv("XDG_CACHE_HOME");
+    auto home = getenv("HOME");
+    if (cache_home && *cache_home) {
+        program_cache.directory = std::string(cache_home) + "/wayfire/glow-decoration";
+    } else if (home && *home) {
+        program_cache.directory = std::string(home) + "/.cache/wayfire/glow-decoration";
+    }
     
-    GLint success;
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    texture_cache.program_cache = &program_cache;
+    
+    auto reload = [this]() {
+        load_config();
+        config_serial++;
+        texture_cache.invalidate();
+        if (!config.adaptive_quality) {
+            governor.reset();
+        }
+        
+        // A new look may need variants nothing has built yet
+        OpenGL::render_begin();
+        prepare_programs();
+        OpenGL::render_end();
+        
+        for (auto instance : instances) {
+            instance->update_config();
+        }
+    };
+    
+    opt_active_color.set_callback(reload);
+    opt_inactive_color.set_callback(reload);
+    opt_glow_radius.set_callback(reload);
+    opt_glow_intensity.set_callback(reload);
+    opt_border_width.set_callback(reload);
+    opt_animation_speed.set_callback(reload);
+    opt_enable_gradient.set_callback(reload);
+    opt_gradient_angle.set_callback(reload);
+    opt_gradient_color_2.set_callback(reload);
+    opt_corner_radius.set_callback(reload);
+    opt_max_device_radius.set_callback(reload);
+    opt_batch_rendering.set_callback(reload);
+    opt_half_resolution.set_callback(reload);
+    opt_merge_glows.set_callback(reload);
+    opt_adaptive_quality.set_callback(reload);
+    opt_quality_budget_high.set_callback(reload);
+    opt_quality_budget_low.set_callback(reload);
+    opt_quality_downgrade_frames.set_callback(reload);
+    opt_quality_upgrade_frames.set_callback(reload);
+    opt_lowest_quality_tier.set_callback(reload);
+    
+#ifdef GLOW_STATS
+    ipc_get_stats = [this] (nlohmann::json) {
+        return stats_to_json();
+    };
+    ipc_reset_stats = [this] (nlohmann::json) {
+        stats = {};
+        return wf::ipc::json_ok();
+    };
+    ipc_repo->register_method("glow-decoration/stats", ipc_get_stats);
+    ipc_repo->register_method("glow-decoration/reset-stats", ipc_reset_stats);
+#endif
+}
+
+glow_runtime_t::~glow_runtime_t() {
+    // Last reference gone: no output renders the glow anymore
+    uint64_t uploads, skipped;
+    get_uniform_stats(uploads, skipped);
+    LOGD("Glow decoration: skipped ", skipped, " of ", uploads + skipped, " uniform uploads");
+    LOGD("Glow decoration: ", program_cache.hits, " of ", program_cache.hits + program_cache.misses,
+        " programs loaded from the program cache");
+    build_timer.disconnect();
+    
+#ifdef GLOW_STATS
+    ipc_repo->unregister_method("glow-decoration/stats");
+    ipc_repo->unregister_method("glow-decoration/reset-stats");
+    LOGI("Glow decoration stats: ", stats_to_json().dump());
+#endif
+    
+    if (geometry.vao || texture_cache.texture || config_ubo) {
+        OpenGL::render_begin();
+        for (auto& [features, variant] : variants) {
+            variant.destroy();
+        }
+        geometry.destroy();
+        texture_cache.destroy();
+        governor.destroy();
+        half_res_buffer.destroy();
+        if (config_ubo) glDeleteBuffers(1, &config_ubo);
+        config_ubo = 0;
+        OpenGL::render_end();
+    }
+}
+
+bool glow_runtime_t::init_gl_resources() {
+    if (!config_ubo) {
+        glGenBuffers(1, &config_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, config_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(glow_config_block_t), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        uploaded_config_serial = 0;
+    }
     
-    if (!success) {
-        char log[1024];
-        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
-        LOGE("Glow program link error: ", log);
+    if (!geometry.create()) {
+        LOGE("Glow decoration: failed to allocate vertex buffers");
         return false;
     }
+    
     return true;
 }
 
-bool glow_program_t::compile_shaders() {
-    if (compiled) return true;
+// The gradient angle as it appears in the target's framebuffer, where the
+// output transform may rotate or mirror the layout axes and rows count upwards
+static float get_device_gradient_angle(const wf::render_target_t& target, float angle) {
+    auto projection = target.get_orthographic_projection();
+    glm::mat2 axes{
+        glm::round(glm::normalize(glm::vec2(projection[0]))),
+        glm::round(glm::normalize(glm::vec2(projection[1]))),
+    };
+    
+    float radians = glm::radians(angle);
+    glm::vec2 direction = axes * glm::vec2(std::cos(radians), -std::sin(radians));
+    return glm::degrees(std::atan2(-direction.y, direction.x));
+}
+
+const glow_config_t& glow_runtime_t::get_device_config(const wf::render_target_t& target) {
+    if (device_source_serial != config_serial || device_scale != target.scale ||
+        device_transform != target.wl_transform) {
+        device_config = config.to_device_pixels(target.scale);
+        device_config.gradient_angle = get_device_gradient_angle(target, config.gradient_angle);
+        device_source_serial = config_serial;
+        device_scale = target.scale;
+        device_transform = target.wl_transform;
+        device_config_serial++;
+    }
+    
+    return device_config;
+}
+
+void glow_runtime_t::bind_config_block(const wf::render_target_t& target) {
+    get_device_config(target);
+    if (uploaded_config_serial != device_config_serial) {
+        auto block = make_glow_config_block(device_config);
+        glBindBuffer(GL_UNIFORM_BUFFER, config_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        uploaded_config_serial = device_config_serial;
+    }
+    
+    glBindBufferBase(GL_UNIFORM_BUFFER, GLOW_CONFIG_BINDING, config_ubo);
+}
+
+void glow_runtime_t::get_uniform_stats(uint64_t& uploads, uint64_t& skipped) const {
+    uploads = skipped = 0;
+    auto add = [&] (const glow_program_t& program) {
+        uploads += program.uniform_uploads;
+        skipped += program.uniform_uploads_skipped;
+    };
+    
+    for (auto& [features, variant] : variants) {
+        add(variant);
+    }
+    
+    add(texture_cache.bake_program);
+    add(texture_cache.sample_program);
+}
+
+// Variants of the three half-resolution passes, see render_half_res()
+static std::array<uint32_t, 3> get_half_res_variants(uint32_t features) {
+    return {
+        features | GLOW_FEATURE_FALLOFF_PASS,
+        (features & GLOW_FEATURE_ROUNDED) | GLOW_FEATURE_COMPOSITE_PASS,
+        GLOW_FEATURE_BORDER_ONLY | (features & ~(GLOW_FEATURE_PULSE | GLOW_FEATURE_EDGE_NOISE)),
+    };
+}
+
+void glow_runtime_t::prepare_programs() {
+    if (!init_gl_resources()) {
+        return;
+    }
     
-    vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    program = glCreateProgram();
+    // With adaptive quality, every tier the governor may move to
+    int first_tier = config.adaptive_quality ? int(GLOW_TIER_FULL) : governor.tier;
+    int lowest_tier = config.adaptive_quality ?
+        std::max(config.lowest_quality_tier, governor.tier) : governor.tier;
+    for (int tier = first_tier; tier <= lowest_tier; tier++) {
+        // The analytic variant also draws what the atlas cannot
+        uint32_t features = get_features(tier);
+        start_program(features);
+        // Merging falls back to plain batches where windows overlap, and
+        // half-resolution batches of border-only glows are drawn as plain ones
+        bool half_res = config.half_resolution || (tier >= GLOW_TIER_HALF_RES);
+        if (config.batch_rendering || config.merge_glows || half_res) {
+            start_program(features | GLOW_FEATURE_INSTANCED);
+        }
+        
+        if (config.merge_glows) {
+            start_program(features | GLOW_FEATURE_INSTANCED | GLOW_FEATURE_MERGED);
+        }
+        
+        if (half_res && !(features & GLOW_FEATURE_BORDER_ONLY)) {
+            for (auto pass : get_half_res_variants(features)) {
+                start_program(pass);
+            }
+        }
+    }
     
-    if (!compile_shader(vertex_shader, glow_vertex_shader)) return false;
-    if (!compile_shader(fragment_shader, glow_fragment_shader)) return false;
+    if (config.can_use_cached_glow() || (lowest_tier >= GLOW_TIER_STATIC)) {
+        texture_cache.create_resources();
+    }
     
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
+    // Cached binaries and drivers without background compiles are done already
+    finish_ready_programs();
+    if (!pending_builds.empty() && !build_timer.is_connected()) {
+        build_timer.set_timeout(GLOW_BUILD_POLL_MS, [this] () {
+            OpenGL::render_begin();
+            finish_ready_programs();
+            OpenGL::render_end();
+            return !pending_builds.empty();
+        });
+    }
+}
+
+void glow_runtime_t::start_program(uint32_t features) {
+    auto& variant = variants[features];
+    if (variant.compiled || variant.building || failed_variants.count(features)) {
+        return;
+    }
     
-    if (!link_program()) return false;
+    auto vertex_source = build_glow_vertex_source(features);
+    auto fragment_source = build_glow_fragment_source(features);
+    if (!program_cache.start(variant, vertex_source, fragment_source)) {
+        LOGE("Glow decoration shader variant ", features, ": ", variant.error_log);
+        variant.destroy();
+        failed_variants.insert(features);
+        return;
+    }
     
-    u_resolution = glGetUniformLocation(program, "u_resolution");
-    u_border_box = glGetUniformLocation(program, "u_border_box");
-    u_glow_color = glGetUniformLocation(program, "u_glow_color");
-    u_glow_color_2 = glGetUniformLocation(program, "u_glow_color_2");
-    u_glow_radius = glGetUniformLocation(program, "u_glow_radius");
-    u_glow_intensity = glGetUniformLocation(program, "u_glow_intensity");
-    u_border_width = glGetUniformLocation(program, "u_border_width");
-    u_time = glGetUniformLocation(program, "u_time");
-    u_enable_gradient = glGetUniformLocation(program, "u_enable_gradient");
-    u_gradient_angle = glGetUniformLocation(program, "u_gradient_angle");
-    u_corner_radius = glGetUniformLocation(program, "u_corner_radius");
+    pending_builds.push_back(features);
+}
+
+bool glow_runtime_t::finish_program(uint32_t features) {
+    auto& variant = variants[features];
+    pending_builds.erase(std::remove(pending_builds.begin(), pending_builds.end(), features),
+        pending_builds.end());
     
-    compiled = true;
-    LOGI("Glow decoration shaders compiled");
+    bool from_source = variant.building;
+    if (!program_cache.finish(variant)) {
+        LOGE("Glow decoration shader variant ", features, ": ", variant.error_log);
+        variant.destroy();
+        failed_variants.insert(features);
+        return false;
+    }
+    
+    GLOW_STAT(stats.compile_us.add(variant.build_us));
+    LOGI("Glow decoration shader variant ", features,
+        from_source ? " compiled" : " loaded from the program cache");
     return true;
 }
 
-void glow_program_t::use() {
-    glUseProgram(program);
+void glow_runtime_t::finish_ready_programs() {
+    // finish_program() edits the list
+    auto pending = pending_builds;
+    for (auto features : pending) {
+        if (program_cache.is_ready(variants.at(features))) {
+            finish_program(features);
+        }
+    }
+}
+
+glow_program_t* glow_runtime_t::get_program(uint32_t features) {
+    auto it = variants.find(features);
+    if ((it != variants.end()) && it->second.compiled) {
+        return &it->second;
+    }
+    
+    // Not prepared, or still building in the background: wait for it now
+    start_program(features);
+    if (failed_variants.count(features) || !finish_program(features)) {
+        return nullptr;
+    }
+    
+    return &variants.at(features);
+}
+
+float glow_runtime_t::get_time() const {
+    auto now = std::chrono::steady_clock::now();
+    return std::chrono::duration<float>(now - start_time).count();
+}
+
+uint32_t glow_runtime_t::get_features() const {
+    return get_features(governor.tier);
+}
+
+uint32_t glow_runtime_t::get_features(int tier) const {
+    uint32_t features = config.features();
+    if (tier >= GLOW_TIER_NO_EDGE_NOISE) {
+        features &= ~GLOW_FEATURE_EDGE_NOISE;
+    }
+    
+    if (tier >= GLOW_TIER_NO_WOBBLE) {
+        features &= ~GLOW_FEATURE_WOBBLE;
+    }
+    
+    if (tier >= GLOW_TIER_STATIC) {
+        features &= ~(GLOW_FEATURE_GRADIENT | GLOW_FEATURE_PULSE);
+    }
+    
+    return features;
+}
+
+bool glow_runtime_t::use_static_glow() const {
+    return config.can_use_cached_glow() || (governor.tier >= GLOW_TIER_STATIC);
+}
+
+bool glow_runtime_t::use_half_resolution() const {
+    return config.half_resolution || (governor.tier >= GLOW_TIER_HALF_RES);
+}
+
+bool glow_runtime_t::is_animated() const {
+    return config.is_time_dependent() && (governor.tier < GLOW_TIER_STATIC);
+}
+
+void glow_runtime_t::frame_done(wf::output_t *output) {
+    // wlr_output reports refresh in mHz, 0 if unknown
+    int refresh = output->handle->refresh;
+    float budget_ms = (refresh > 0) ? 1e6f / refresh : 1000.0f / 60.0f;
+    GLOW_STAT(stats.end_frame());
+    if (!governor.frame_done(output, budget_ms, config)) {
+        return;
+    }
+    
+    LOGI("Glow decoration quality tier ", governor.tier);
+    for (auto instance : instances) {
+        instance->update_config();
+    }
+}
+
+void glow_runtime_t::register_instance(glow_decoration_t *instance) {
+    instances.push_back(instance);
+}
+
+void glow_runtime_t::unregister_instance(glow_decoration_t *instance) {
+    instances.erase(std::remove(instances.begin(), instances.end(), instance), instances.end());
+    governor.remove_output(instance->output);
+}
+
+void glow_runtime_t::load_config() {
+    auto to_vec4 = [](const wf::color_t& c) -> glm::vec4 {
+        return glm::vec4(c.r, c.g, c.b, c.a);
+    };
+    
+    config.active_color = to_vec4(opt_active_color);
+    config.inactive_color = to_vec4(opt_inactive_color);
+    config.glow_radius = opt_glow_radius;
+    config.glow_intensity = opt_glow_intensity;
+    config.border_width = opt_border_width;
+    config.animation_speed = opt_animation_speed;
+    config.enable_gradient = opt_enable_gradient;
+    config.gradient_angle = opt_gradient_angle;
+    config.gradient_color_2 = to_vec4(opt_gradient_color_2);
+    config.corner_radius = opt_corner_radius;
+    config.max_device_radius = opt_max_device_radius;
+    config.batch_rendering = opt_batch_rendering;
+    config.half_resolution = opt_half_resolution;
+    config.merge_glows = opt_merge_glows;
+    config.adaptive_quality = opt_adaptive_quality;
+    config.quality_budget_high = opt_quality_budget_high;
+    config.quality_budget_low = opt_quality_budget_low;
+    config.quality_downgrade_frames = opt_quality_downgrade_frames;
+    config.quality_upgrade_frames = opt_quality_upgrade_frames;
+    config.lowest_quality_tier = opt_lowest_quality_tier;
+}
+
+#ifdef GLOW_STATS
+static nlohmann::json histogram_to_json(const glow_histogram_t& histogram) {
+    nlohmann::json out;
+    out["count"] = histogram.count;
+    out["mean"] = histogram.mean();
+    out["p50"] = histogram.percentile(0.5);
+    out["p90"] = histogram.percentile(0.9);
+    out["p99"] = histogram.percentile(0.99);
+    out["max"] = histogram.max;
+    return out;
+}
+
+nlohmann::json glow_runtime_t::stats_to_json() {
+    uint64_t uploads, skipped;
+    get_uniform_stats(uploads, skipped);
+    
+    nlohmann::json out;
+    out["draws_per_frame"] = histogram_to_json(stats.draws_per_frame);
+    out["pixels_per_frame"] = histogram_to_json(stats.pixels_per_frame);
+    out["render_us_per_frame"] = histogram_to_json(stats.render_us);
+    out["animation_us_per_tick"] = histogram_to_json(stats.animation_us);
+    out["animation_damage_per_tick"] = histogram_to_json(stats.animation_damage);
+    out["compile_us"] = histogram_to_json(stats.compile_us);
+    out["program_cache_hits"] = program_cache.hits;
+    out["program_cache_misses"] = program_cache.misses;
+    out["animation_ticks"] = stats.animation_ticks;
+    out["animation_wakeups"] = stats.animation_wakeups;
+    out["uniform_uploads"] = uploads;
+    out["uniform_uploads_skipped"] = skipped;
+    out["quality_tier"] = governor.tier;
+    return out;
+}
+
+// Pixel count of a region, for the coverage and damage histograms
+static double region_area(const wf::region_t& region) {
+    double area = 0.0;
+    for (auto& box : region) {
+        area += double(box.x2 - box.x1) * (box.y2 - box.y1);
+    }
+    
+    return area;
+}
+#endif
+
+wf::geometry_t compute_glow_bounding_box(const wf::geometry_t& view_box, const glow_config_t& config) {
+    int expand = static_cast<int>(config.glow_radius + config.border_width);
+    return {
+        view_box.x - expand,
+        view_box.y - expand,
+        view_box.width + 2 * expand,
+        view_box.height + 2 * expand
+    };
+}
+
+wf::region_t compute_glow_centre(const wf::geometry_t& view_box, const glow_config_t& config) {
+    // Rounded inwards so no glow pixel is lost
+    auto ring = compute_glow_ring(view_box, config);
+    int x1 = static_cast<int>(std::ceil(ring.x[1]));
+    int y1 = static_cast<int>(std::ceil(ring.y[1]));
+    int x2 = static_cast<int>(std::floor(ring.x[2]));
+    int y2 = static_cast<int>(std::floor(ring.y[2]));
+    if (x2 <= x1 || y2 <= y1) {
+        return {};
+    }
+    
+    return wf::region_t{wf::geometry_t{x1, y1, x2 - x1, y2 - y1}};
+}
+
+wf::region_t compute_glow_region(const wf::geometry_t& view_box, const glow_config_t& config) {
+    auto bbox = compute_glow_bounding_box(view_box, config);
+    if (bbox.width <= 0 || bbox.height <= 0) {
+        return {};
+    }
+    
+    wf::region_t region{bbox};
+    region ^= compute_glow_centre(view_box, config);
+    return region;
+}
+
+wf::region_t compute_stable_glow_region(const wf::geometry_t& old_box,
+    const wf::geometry_t& new_box, const glow_config_t& config) {
+    // Gradients and edge noise are laid out relative to the window centre
+    uint32_t features = config.features();
+    if (features & (GLOW_FEATURE_GRADIENT | GLOW_FEATURE_EDGE_NOISE)) {
+        return {};
+    }
+    
+    float glow_r = (features & GLOW_FEATURE_BORDER_ONLY) ? 0.0f : config.glow_radius;
+    float border = config.border_width;
+    auto corner_r = [&] (const wf::geometry_t& box) {
+        return std::min(config.corner_radius, std::min(box.width, box.height) * 0.5f);
+    };
+    
+    // Inside the box the nearest edge decides; stay border_width clear of the
+    // perpendicular edges and outside both boxes' corner arcs
+    float edge_clear = std::max(corner_r(old_box), corner_r(new_box)) + border;
+    if (config.can_use_cached_glow()) {
+        // The atlas path samples its corner tiles this far along each edge
+        edge_clear = std::max(edge_clear, std::ceil(glow_r + border + config.corner_radius));
+    }
+    
+    int outer = static_cast<int>(std::ceil(glow_r));
+    int inner = static_cast<int>(std::floor(border));
+    
+    int span_y1 = static_cast<int>(std::ceil(std::max(old_box.y, new_box.y) + edge_clear));
+    int span_y2 = static_cast<int>(std::floor(std::min(old_box.y + old_box.height,
+        new_box.y + new_box.height) - edge_clear));
+    int span_x1 = static_cast<int>(std::ceil(std::max(old_box.x, new_box.x) + edge_clear));
+    int span_x2 = static_cast<int>(std::floor(std::min(old_box.x + old_box.width,
+        new_box.x + new_box.width) - edge_clear));
+    
+    wf::region_t stable;
+    if (span_y2 > span_y1) {
+        if (old_box.x == new_box.x) {
+            stable |= wf::geometry_t{old_box.x - outer, span_y1, outer + inner, span_y2 - span_y1};
+        }
+        
+        int old_right = old_box.x + old_box.width;
+        if (old_right == new_box.x + new_box.width) {
+            stable |= wf::geometry_t{old_right - inner, span_y1, outer + inner, span_y2 - span_y1};
+        }
+    }
+    
+    if (span_x2 > span_x1) {
+        if (old_box.y == new_box.y) {
+            stable |= wf::geometry_t{span_x1, old_box.y - outer, span_x2 - span_x1, outer + inner};
+        }
+        
+        int old_bottom = old_box.y + old_box.height;
+        if (old_bottom == new_box.y + new_box.height) {
+            stable |= wf::geometry_t{span_x1, old_bottom - inner, span_x2 - span_x1, outer + inner};
+        }
+    }
+    
+    return stable;
+}
+
+bool merge_damage_boxes(const wf::region_t& damage, std::vector<wlr_box>& out) {
+    out.clear();
+    
+    // pixman keeps boxes sorted in y-x bands; join neighbours within a band
+    for (auto& pbox : damage) {
+        auto box = wlr_box_from_pixman_box(pbox);
+        if (!out.empty()) {
+            auto& last = out.back();
+            if (last.y == box.y && last.height == box.height &&
+                last.x + last.width >= box.x) {
+                last.width = std::max(last.x + last.width, box.x + box.width) - last.x;
+                continue;
+            }
+        }
+        
+        if (out.size() >= GLOW_MAX_SCISSOR_BOXES * 4) {
+            return false;
+        }
+        out.push_back(box);
+    }
+    
+    // Then stack boxes with identical columns from consecutive bands
+    std::vector<wlr_box> merged;
+    for (auto& box : out) {
+        auto it = std::find_if(merged.begin(), merged.end(), [&] (const wlr_box& m) {
+            return m.x == box.x && m.width == box.width && m.y + m.height == box.y;
+        });
+        
+        if (it != merged.end()) {
+            it->height += box.height;
+        } else {
+            merged.push_back(box);
+        }
+    }
+    
+    out = std::move(merged);
+    return out.size() <= GLOW_MAX_SCISSOR_BOXES;
+}
+
+// A layout box in the target's framebuffer, in device pixels with rows
+// counted upwards, as glScissor() and gl_FragCoord have them
+static wf::geometry_t get_device_box(const wf::render_target_t& target, const wf::geometry_t& box) {
+    // Handles output scale and transform relative to target.geometry
+    auto fb_box = target.framebuffer_box_from_geometry_box(box);
+    fb_box.y = target.viewport_height - fb_box.y - fb_box.height;
+    return fb_box;
+}
+
+// The part of the framebuffer the target is drawn into, in the same pixels
+static wf::geometry_t get_device_viewport(const wf::render_target_t& target) {
+    if (target.subbuffer) {
+        auto viewport = *target.subbuffer;
+        viewport.y = target.viewport_height - viewport.y - viewport.height;
+        return viewport;
+    }
+    
+    return {0, 0, target.viewport_width, target.viewport_height};
+}
+
+/**
+ * A layout box relative to the target's viewport: the space the glow
+ * shaders work in. Rotated outputs swap width and height, and scaled ones
+ * draw the ring in whole device pixels instead of stretching a layout one.
+ */
+static wf::geometry_t get_viewport_box(const wf::render_target_t& target, const wf::geometry_t& box) {
+    auto device_box = get_device_box(target, box);
+    auto viewport = get_device_viewport(target);
+    device_box.x -= viewport.x;
+    device_box.y -= viewport.y;
+    return device_box;
+}
+
+// Clip ring draws to the damaged area; too many boxes collapse into one draw over the extents
+static void draw_ring_clipped(const wf::render_target_t& target, const wf::region_t& damage,
+    GLsizei instance_count) {
+    std::vector<wlr_box> boxes;
+    if (!merge_damage_boxes(damage, boxes)) {
+        boxes.assign(1, wlr_box_from_pixman_box(damage.get_extents()));
+    }
+    
+    glEnable(GL_SCISSOR_TEST);
+    for (auto& box : boxes) {
+        auto device_box = get_device_box(target, box);
+        glScissor(device_box.x, device_box.y, device_box.width, device_box.height);
+        if (instance_count > 0) {
+            glDrawElementsInstanced(GL_TRIANGLES, GLOW_RING_INDEX_COUNT, GL_UNSIGNED_BYTE,
+                                    nullptr, instance_count);
+        } else {
+            glDrawElements(GL_TRIANGLES, GLOW_RING_INDEX_COUNT, GL_UNSIGNED_BYTE, nullptr);
+        }
+    }
+    glDisable(GL_SCISSOR_TEST);
 }
 
-void glow_program_t::destroy() {
-    if (program) glDeleteProgram(program);
-    if (vertex_shader) glDeleteShader(vertex_shader);
-    if (fragment_shader) glDeleteShader(fragment_shader);
-    program = vertex_shader = fragment_shader = 0;
-    compiled = false;
+// Per-window draw values for a box from get_viewport_box(), with the fade-in opacity applied
+static glow_instance_t make_window_instance(glow_decoration_node_t& node,
+    const wf::geometry_t& box) {
+    glm::vec4 color = node.get_glow_color();
+    glm::vec4 grad_color = node.runtime->config.gradient_color_2;
+    color.a *= node.opacity;
+    grad_color.a *= node.opacity;
+    
+    glow_instance_t instance;
+    instance.border_box[0] = box.x;
+    instance.border_box[1] = box.y;
+    instance.border_box[2] = box.width;
+    instance.border_box[3] = box.height;
+    std::copy_n(glm::value_ptr(color), 4, instance.glow_color);
+    std::copy_n(glm::value_ptr(grad_color), 4, instance.glow_color_2);
+    instance.time = node.animation_time;
+    return instance;
 }
 
+// Glows drawn together by one instruction, front-most (the batch owner) first
+struct glow_batch_t {
+    std::vector<std::shared_ptr<glow_decoration_node_t>> nodes;
+};
+
+using glow_batch_ptr = std::shared_ptr<glow_batch_t>;
+
+/**
+ * Whether the batch may be shaded as one field. The merged shader gives each
+ * pixel the look of the nearest window and leaves window interiors out, so
+ * with overlapping windows it would drop the glow of a window in front over
+ * the one behind, or pick the colour of the wrong one.
+ */
+static bool can_merge_batch(const glow_batch_t& batch) {
+    std::vector<wf::geometry_t> boxes;
+    for (auto& node : batch.nodes) {
+        if (!node->view || !node->view->is_mapped() || node->opacity <= 0.0f) {
+            continue;
+        }
+        
+        auto box = node->view->get_bounding_box();
+        for (auto& other : boxes) {
+            if (box.x < other.x + other.width && other.x < box.x + box.width &&
+                box.y < other.y + other.height && other.y < box.y + box.height) {
+                return false;
+            }
+        }
+        
+        boxes.push_back(box);
+    }
+    
+    return true;
+}
+
+// How far back schedule_instructions() looks for a batch to join
+static constexpr int GLOW_BATCH_LOOKBACK = 16;
+
 // Render instance
 class glow_render_instance_t : public wf::scene::render_instance_t {
     std::shared_ptr<glow_decoration_node_t> self;
+    wf::output_t *output;
     wf::scene::damage_callback push_damage;
     wf::signal::connection_t<wf::scene::node_damage_signal> on_damage;
     
+    /**
+     * Instructions are collected front to back and drawn back to front. A glow
+     * may be drawn later, together with a glow in front of it, if nothing
+     * scheduled between the two touches its ring - then the move cannot
+     * change the blending order of any pixel. The whole ring is tested, not
+     * just its damage: the batch is scissored to the damage of all its glows,
+     * so this one is also drawn where opaque surfaces in between cut it out.
+     */
+    bool try_join_batch(std::vector<wf::scene::render_instruction_t>& instructions,
+        const wf::render_target_t& target, const wf::region_t& region,
+        const wf::region_t& glow_region) {
+        int steps = 0;
+        for (auto it = instructions.rbegin();
+             it != instructions.rend() && steps < GLOW_BATCH_LOOKBACK; ++it, ++steps) {
+            auto batch = std::any_cast<glow_batch_ptr>(&it->data);
+            if (batch && *batch) {
+                if (it->target.fb != target.fb || it->target.geometry != target.geometry) {
+                    return false;
+                }
+                
+                (*batch)->nodes.push_back(self);
+                it->damage |= region;
+                return true;
+            }
+            
+            if (!(it->damage & glow_region).empty()) {
+                return false;
+            }
+        }
+        
+        return false;
+    }
+    
   public:
     glow_render_instance_t(std::shared_ptr<glow_decoration_node_t> node,
                            wf::scene::damage_callback push_damage_cb,
                            wf::output_t *output)
-        : self(node), push_damage(push_damage_cb) {
+        : self(node), output(output), push_damage(push_damage_cb) {
+        
+        on_damage = [=] (wf::scene::node_damage_signal *ev) {
+            push_damage(ev->region);
+        };
+        self->connect(&on_damage);
+    }
+    
+    ~glow_render_instance_t() {
+        // Disabled (e.g. minimized) views drop their instances without
+        // another visibility pass, so stop counting the glow as on screen
+        self->set_visible(false);
+    }
+    
+    void schedule_instructions(
+        std::vector<wf::scene::render_instruction_t>& instructions,
+        const wf::render_target_t& target,
+        wf::region_t& damage) override {
+        
+        // Opaque surfaces in front are already cut out of the damage, so this
+        // also culls occluded glows. Damage inside the window itself (client
+        // commits) never reaches the hollow centre of the ring.
+        auto glow_region = self->get_glow_region();
+        wf::region_t our_region = glow_region & damage;
+        
+        if (our_region.empty()) {
+            return;
+        }
+        
+        // Static glows keep their per-window draws; half-resolution ones are
+        // always batched, so they share one pass into the scratch buffer
+        auto& runtime = *self->runtime.get();
+        bool batched = runtime.config.batch_rendering || runtime.config.merge_glows ||
+            runtime.use_half_resolution();
+        if (batched && !runtime.use_static_glow()) {
+            if (try_join_batch(instructions, target, our_region, glow_region)) {
+                return;
+            }
+            
+            auto batch = std::make_shared<glow_batch_t>();
+            batch->nodes.push_back(self);
+            instructions.push_back(wf::scene::render_instruction_t{
+                .instance = this,
+                .target = target,
+                .damage = std::move(our_region),
+                .data = batch,
+            });
+            return;
+        }
+        
+        instructions.push_back(wf::scene::render_instruction_t{
+            .instance = this,
+            .target = target,
+            .damage = std::move(our_region),
+            .data = {},
+        });
+    }
+    
+    void render(const wf::scene::render_instruction_t& instr) override {
+        auto& runtime = *self->runtime.get();
+        GLOW_STAT(auto render_start = std::chrono::steady_clock::now());
+        if (runtime.config.adaptive_quality) {
+            runtime.governor.begin_draw(output);
+        }
+        
+        auto batch = std::any_cast<glow_batch_ptr>(&instr.data);
+        if (batch && *batch) {
+            if (render_half_res_batch(instr, **batch)) {
+                // Done, the falloffs shared one scratch pass
+            } else if (runtime.config.merge_glows && can_merge_batch(**batch)) {
+                render_merged(instr, **batch);
+            } else {
+                render_batch(instr, **batch);
+            }
+        } else {
+            render_single(instr);
+        }
+        
+        runtime.governor.end_draw();
+        GLOW_STAT(runtime.stats.frame_draws++);
+        GLOW_STAT(runtime.stats.frame_pixels += region_area(instr.damage));
+        GLOW_STAT(runtime.stats.frame_render_us += glow_elapsed_us(render_start));
+    }
+    
+    bool render_half_res_batch(const wf::scene::render_instruction_t& instr, const glow_batch_t& batch) {
+        auto& runtime = *self->runtime.get();
+        uint32_t features = runtime.get_features();
+        if (!runtime.use_half_resolution() || (features & GLOW_FEATURE_BORDER_ONLY) ||
+            !runtime.init_gl_resources()) {
+            return false;
+        }
+        
+        std::vector<glow_decoration_node_t*> nodes;
+        for (auto it = batch.nodes.rbegin(); it != batch.nodes.rend(); ++it) {
+            auto& node = *it;
+            if (node->view && node->view->is_mapped() && node->opacity > 0.0f) {
+                nodes.push_back(node.get());
+            }
+        }
+        
+        return render_half_res(instr, features, nodes);
+    }
+    
+    void render_batch(const wf::scene::render_instruction_t& instr, const glow_batch_t& batch) {
+        auto& runtime = *self->runtime.get();
+        if (!runtime.init_gl_resources()) {
+            return;
+        }
+        
+        auto program_ptr = runtime.get_program(runtime.get_features() | GLOW_FEATURE_INSTANCED);
+        if (!program_ptr) {
+            return;
+        }
+        
+        auto& program = *program_ptr;
+        auto& target = instr.target;
+        auto viewport = get_device_viewport(target);
         
-        on_damage = [=] (wf::scene::node_damage_signal *ev) {
-            push_damage(ev->region);
-        };
-        self->connect(&on_damage);
+        // Back to front, so overlapping glows blend as they would one by one
+        std::vector<glow_instance_t> instances;
+        instances.reserve(batch.nodes.size());
+        for (auto it = batch.nodes.rbegin(); it != batch.nodes.rend(); ++it) {
+            auto& node = *it;
+            if (!node->view || !node->view->is_mapped() || node->opacity <= 0.0f) {
+                continue;
+            }
+            
+            auto box = get_viewport_box(target, node->view->get_bounding_box());
+            instances.push_back(make_window_instance(*node, box));
+        }
+        
+        if (instances.empty()) {
+            return;
+        }
+        
+        runtime.geometry.upload_instances(instances);
+        
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        
+        program.use();
+        runtime.bind_config_block(target);
+        program.set_uniform(program.u_resolution, viewport.width, viewport.height);
+        
+        glBindVertexArray(runtime.geometry.instanced_vao);
+        draw_ring_clipped(target, instr.damage, static_cast<GLsizei>(instances.size()));
+        glBindVertexArray(0);
     }
     
-    void schedule_instructions(
-        std::vector<wf::scene::render_instruction_t>& instructions,
-        const wf::render_target_t& target,
-        wf::region_t& damage) override {
+    /**
+     * The glows of a batch shaded as one field, GLOW_MAX_MERGED windows at a
+     * time. Their rings are joined into disjoint rectangles, one instance
+     * each, so pixels where rings overlap are shaded and blended once, with
+     * the look of the nearest window.
+     */
+    void render_merged(const wf::scene::render_instruction_t& instr, const glow_batch_t& batch) {
+        auto& runtime = *self->runtime.get();
+        auto& config = runtime.config;
+        if (!runtime.init_gl_resources()) {
+            return;
+        }
         
-        auto bbox = self->get_bounding_box();
-        wf::region_t our_region{bbox};
-        our_region &= damage;
+        auto program_ptr = runtime.get_program(
+            runtime.get_features() | GLOW_FEATURE_INSTANCED | GLOW_FEATURE_MERGED);
+        if (!program_ptr) {
+            return;
+        }
         
-        if (!our_region.empty()) {
-            instructions.push_back(wf::scene::render_instruction_t{
-                .instance = this,
-                .target = target,
-                .damage = std::move(our_region),
-            });
+        auto& program = *program_ptr;
+        auto& target = instr.target;
+        auto viewport = get_device_viewport(target);
+        
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        
+        program.use();
+        runtime.bind_config_block(target);
+        program.set_uniform(program.u_resolution, viewport.width, viewport.height);
+        glBindVertexArray(runtime.geometry.instanced_vao);
+        
+        std::vector<float> boxes, colors, colors_2, times;
+        std::vector<glow_instance_t> rects;
+        wf::region_t rings, centres;
+        int count = 0;
+        
+        auto draw_merged = [&] () {
+            // Window interiors are inside the field, so nothing there is drawn
+            rings ^= centres;
+            rings &= instr.damage;
+            for (auto& box : rings) {
+                auto device_box = get_viewport_box(target, wlr_box_from_pixman_box(box));
+                glow_instance_t rect{};
+                rect.border_box[0] = device_box.x;
+                rect.border_box[1] = device_box.y;
+                rect.border_box[2] = device_box.width;
+                rect.border_box[3] = device_box.height;
+                rects.push_back(rect);
+            }
+            
+            if (!rects.empty()) {
+                program.set_uniform_int(program.u_box_count, count);
+                program.set_uniform_array(program.u_boxes, boxes, 4);
+                program.set_uniform_array(program.u_box_colors, colors, 4);
+                program.set_uniform_array(program.u_box_colors_2, colors_2, 4);
+                program.set_uniform_array(program.u_box_times, times, 1);
+                runtime.geometry.upload_instances(rects);
+                glDrawElementsInstanced(GL_TRIANGLES, GLOW_RING_INDEX_COUNT, GL_UNSIGNED_BYTE,
+                    nullptr, static_cast<GLsizei>(rects.size()));
+            }
+            
+            boxes.clear();
+            colors.clear();
+            colors_2.clear();
+            times.clear();
+            rects.clear();
+            rings.clear();
+            centres.clear();
+            count = 0;
+        };
+        
+        // Back to front, so later groups blend over earlier ones
+        for (auto it = batch.nodes.rbegin(); it != batch.nodes.rend(); ++it) {
+            auto& node = *it;
+            if (!node->view || !node->view->is_mapped() || node->opacity <= 0.0f) {
+                continue;
+            }
+            
+            auto view_bbox = node->view->get_bounding_box();
+            auto window = make_window_instance(*node, get_viewport_box(target, view_bbox));
+            boxes.insert(boxes.end(), window.border_box, window.border_box + 4);
+            colors.insert(colors.end(), window.glow_color, window.glow_color + 4);
+            colors_2.insert(colors_2.end(), window.glow_color_2, window.glow_color_2 + 4);
+            times.push_back(window.time);
+            rings |= compute_glow_region(view_bbox, config);
+            centres |= compute_glow_centre(view_bbox, config);
+            if (++count == GLOW_MAX_MERGED) {
+                draw_merged();
+            }
+        }
+        
+        if (count > 0) {
+            draw_merged();
         }
+        
+        glBindVertexArray(0);
     }
     
-    void render(const wf::scene::render_instruction_t& instr) override {
+    void render_single(const wf::scene::render_instruction_t& instr) {
         auto& node = self;
         if (!node->view || !node->view->is_mapped()) {
             return;
         }
         
-        if (!g_glow_program.compiled) {
-            if (!g_glow_program.compile_shaders()) {
-                return;
-            }
+        auto& runtime = *node->runtime.get();
+        if (!runtime.init_gl_resources()) {
+            return;
         }
 
             // Skip if fully transparent
@@ -149,131 +1341,329 @@ class glow_render_instance_t : public wf::scene::render_instance_t {
     }
         
         auto view_bbox = node->view->get_bounding_box();
-        float glow_r = g_config.glow_radius;
-        
-        // Geometry for the quad (expanded by glow radius)
-        wf::geometry_t geom = {
-            static_cast<int>(view_bbox.x - glow_r),
-            static_cast<int>(view_bbox.y - glow_r),
-            static_cast<int>(view_bbox.width + 2 * glow_r),
-            static_cast<int>(view_bbox.height + 2 * glow_r)
-        };
-        
         auto& target = instr.target;
+        auto& device_config = runtime.get_device_config(target);
         
-        // Target geometry defines the viewport - coordinates are relative to this
-        auto fb_geom = target.geometry;
-        float fb_w = static_cast<float>(fb_geom.width);
-        float fb_h = static_cast<float>(fb_geom.height);
-        
-        // Convert from output coordinates to framebuffer-relative coordinates
-        float rel_x = static_cast<float>(geom.x - fb_geom.x);
-        float rel_y = static_cast<float>(geom.y - fb_geom.y);
-        float rel_w = static_cast<float>(geom.width);
-        float rel_h = static_cast<float>(geom.height);
-        
-        // Convert to NDC (-1 to 1)
-        float left   = (rel_x / fb_w) * 2.0f - 1.0f;
-        float right  = ((rel_x + rel_w) / fb_w) * 2.0f - 1.0f;
-        float top    = (rel_y / fb_h) * 2.0f - 1.0f;
-        float bottom = ((rel_y + rel_h) / fb_h) * 2.0f - 1.0f;
-        
-        // Vertices in NDC
-        float vertices[] = {
-            left,  top,
-            right, top,
-            right, bottom,
-            left,  bottom,
-        };
+        // Static looks sample the baked atlas instead of evaluating the SDF per pixel
+        const glow_atlas_entry_t *tile = nullptr;
+        if (runtime.use_static_glow()) {
+            tile = runtime.texture_cache.lookup(device_config,
+                get_viewport_box(target, view_bbox), runtime.geometry);
+        }
+        
+        // Large soft falloffs may be shaded at half resolution instead
+        uint32_t features = runtime.get_features();
+        if (!tile && runtime.use_half_resolution() && !(features & GLOW_FEATURE_BORDER_ONLY) &&
+            render_half_res(instr, features, {node.get()})) {
+            return;
+        }
+        
+        // Otherwise bind the cheapest variant that still matches the configuration
+        auto program_ptr = tile ? &runtime.texture_cache.sample_program :
+            runtime.get_program(features);
+        if (!program_ptr) {
+            return;
+        }
+        
+        auto& program = *program_ptr;
         
         glEnable(GL_BLEND);
         glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
         
-        g_glow_program.use();
-        
-        // Pass framebuffer resolution
-        glUniform2f(g_glow_program.u_resolution, fb_w, fb_h);
-        
-        // Pass border box in framebuffer-relative coordinates
-        glUniform4f(g_glow_program.u_border_box,
-                    static_cast<float>(view_bbox.x - fb_geom.x),
-                    static_cast<float>(view_bbox.y - fb_geom.y),
-                    static_cast<float>(view_bbox.width),
-                    static_cast<float>(view_bbox.height));
-        
-glm::vec4 color = node->is_active ? g_config.active_color : g_config.inactive_color;
-color.a *= node->opacity;  // Apply fade opacity
-glUniform4fv(g_glow_program.u_glow_color, 1, glm::value_ptr(color));
-
-glm::vec4 grad_color = g_config.gradient_color_2;
-grad_color.a *= node->opacity;  // Apply fade opacity to gradient too
-glUniform4fv(g_glow_program.u_glow_color_2, 1, glm::value_ptr(grad_color));
-        
-        glUniform1f(g_glow_program.u_glow_radius, g_config.glow_radius);
-        glUniform1f(g_glow_program.u_glow_intensity, g_config.glow_intensity);
-        glUniform1f(g_glow_program.u_border_width, g_config.border_width);
-        glUniform1f(g_glow_program.u_time, node->animation_time);
-        glUniform1i(g_glow_program.u_enable_gradient, g_config.enable_gradient ? 1 : 0);
-        glUniform1f(g_glow_program.u_gradient_angle, g_config.gradient_angle);
-        glUniform1f(g_glow_program.u_corner_radius, g_config.corner_radius);
-        
-        GLuint vao, vbo;
-        glGenVertexArrays(1, &vao);
-        glGenBuffers(1, &vbo);
-        
-        glBindVertexArray(vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STREAM_DRAW);
-        
-        // Position attribute only (2 floats per vertex)
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-        /*
-        glEnable(GL_SCISSOR_TEST);
-        for (auto& box : instr.damage) {
-            auto sbox = wlr_box_from_pixman_box(box);
-            // Convert scissor coordinates to framebuffer-relative
-            int scissor_x = sbox.x - fb_geom.x;
-            int scissor_y = sbox.y - fb_geom.y;
-            // OpenGL scissor has Y=0 at bottom, so flip
-            glScissor(scissor_x, fb_geom.height - scissor_y - sbox.height,
-                      sbox.width, sbox.height);
-            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-        }
-        glDisable(GL_SCISSOR_TEST);
-        */
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-
+        program.use();
+        
+        if (tile) {
+            // The atlas shader takes its few config values as plain uniforms
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, runtime.texture_cache.texture);
+            program.set_uniform_int(program.u_atlas, 0);
+            program.set_uniform(program.u_atlas_size, glow_texture_cache_t::ATLAS_SIZE,
+                                glow_texture_cache_t::ATLAS_SIZE);
+            program.set_uniform(program.u_atlas_tile, tile->x, tile->y, tile->size);
+            program.set_uniform(program.u_glow_radius, device_config.glow_radius);
+            program.set_uniform(program.u_glow_intensity, device_config.glow_intensity);
+            program.set_uniform(program.u_border_width, device_config.border_width);
+            program.set_uniform(program.u_corner_radius, device_config.corner_radius);
+        } else {
+            runtime.bind_config_block(target);
+        }
+        
+        set_window_uniforms(program, target, *node);
+        
+        glBindVertexArray(runtime.geometry.vao);
+        draw_ring_clipped(target, instr.damage, 0);
+        glBindVertexArray(0);
+        if (tile) {
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+    
+    /**
+     * Per-window state in the device pixels of the viewport; unchanged values
+     * are skipped by the shadow cache. The ring is laid out around the device
+     * box, so its edges fall on whole pixels and end where the falloff does.
+     */
+    void set_window_uniforms(glow_program_t& program, const wf::render_target_t& target,
+        glow_decoration_node_t& node, bool border_only = false) {
+        auto& runtime = *self->runtime.get();
+        auto viewport = get_device_viewport(target);
+        program.set_uniform(program.u_resolution, viewport.width, viewport.height);
+        
+        auto box = get_viewport_box(target, node.view->get_bounding_box());
+        auto ring = compute_glow_ring(box, runtime.get_device_config(target), border_only);
+        set_glow_window_uniforms(program, ring, make_window_instance(node, box));
+    }
+    
+    // Where one glow's falloff went in the half-size scratch buffer
+    struct half_res_tile_t {
+        glow_decoration_node_t *node;
+        int x, y;                    // origin in the scratch buffer
+        int x1, y1, x2, y2;          // area in half viewport pixels
+    };
+    
+    /**
+     * Three passes: the falloff is shaded into the half-size scratch buffer,
+     * then upsampled bilinearly outside the box, and the border band is drawn
+     * on top at full resolution. The falloffs of all glows, back to front, get
+     * tiles of their own in the scratch buffer and are shaded before any is
+     * composited, so the target is left only once per batch - every switch
+     * costs a tile resolve on tiled GPUs. Returns false if a pass is
+     * unavailable, so the caller falls back to the full-resolution draw.
+     */
+    bool render_half_res(const wf::scene::render_instruction_t& instr, uint32_t features,
+        const std::vector<glow_decoration_node_t*>& nodes) {
+        auto& runtime = *self->runtime.get();
+        auto& target = instr.target;
+        
+        auto passes = get_half_res_variants(features);
+        auto falloff = runtime.get_program(passes[0]);
+        auto composite = runtime.get_program(passes[1]);
+        auto border = runtime.get_program(passes[2]);
+        if (!falloff || !composite || !border) {
+            return false;
+        }
+        
+        // The passes map between the target's viewport and the scratch
+        // buffer; whatever viewport was bound is put back after pass 1
+        auto viewport = get_device_viewport(target);
+        GLint prev_viewport[4];
+        GLint prev_fb;
+        glGetIntegerv(GL_VIEWPORT, prev_viewport);
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fb);
+        
+        int half_w = (viewport.width + 1) / 2;
+        int half_h = (viewport.height + 1) / 2;
+        auto& buffer = runtime.half_res_buffer;
+        if (!buffer.ensure(half_w, half_h)) {
+            return false;
+        }
+        
+        runtime.bind_config_block(target);
+        glBindVertexArray(runtime.geometry.vao);
+        
+        std::vector<half_res_tile_t> tiles;
+        auto draw_tiles = [&] () {
+            // 1. Falloffs into the scratch buffer. The vertex stage hands the
+            // fragment stage full-resolution positions, so only the viewport
+            // changes, shifted to put each glow's area on its tile.
+            glBindFramebuffer(GL_FRAMEBUFFER, buffer.framebuffer);
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glDisable(GL_BLEND);
+            glEnable(GL_SCISSOR_TEST);
+            falloff->use();
+            for (auto& tile : tiles) {
+                glViewport(tile.x - tile.x1, tile.y - tile.y1, half_w, half_h);
+                glScissor(tile.x, tile.y, tile.x2 - tile.x1, tile.y2 - tile.y1);
+                set_window_uniforms(*falloff, target, *tile.node);
+                glDrawElements(GL_TRIANGLES, GLOW_RING_INDEX_COUNT, GL_UNSIGNED_BYTE, nullptr);
+            }
+            
+            glDisable(GL_SCISSOR_TEST);
+            glBindFramebuffer(GL_FRAMEBUFFER, prev_fb);
+            glViewport(prev_viewport[0], prev_viewport[1], prev_viewport[2], prev_viewport[3]);
+            
+            // 2. Upsample each outside its box, 3. crisp border band on top
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            glActiveTexture(GL_TEXTURE0);
+            for (auto& tile : tiles) {
+                glBindTexture(GL_TEXTURE_2D, buffer.texture);
+                composite->use();
+                composite->set_uniform_int(composite->u_half_res, 0);
+                composite->set_uniform(composite->u_half_res_map,
+                    viewport.x + 2 * (tile.x1 - tile.x), viewport.y + 2 * (tile.y1 - tile.y),
+                    0.5f / buffer.width, 0.5f / buffer.height);
+                set_window_uniforms(*composite, target, *tile.node);
+                draw_ring_clipped(target, instr.damage, 0);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                
+                border->use();
+                set_window_uniforms(*border, target, *tile.node, true);
+                draw_ring_clipped(target, instr.damage, 0);
+            }
+            
+            tiles.clear();
+        };
+        
+        // Shelf packing with a 1 texel gap, so bilinear taps stay on their tile
+        int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+        auto& config = runtime.config;
+        for (auto node : nodes) {
+            // Half-size area around the damage of this glow, one texel wider
+            // on each side for the bilinear taps of the composite pass
+            auto view_bbox = node->view->get_bounding_box();
+            auto damage = compute_glow_region(view_bbox, config) & instr.damage;
+            if (damage.empty()) {
+                continue;
+            }
+            
+            auto fb_box = get_device_box(target, wlr_box_from_pixman_box(damage.get_extents()));
+            half_res_tile_t tile{node, 0, 0,
+                std::max((fb_box.x - viewport.x) / 2 - 1, 0),
+                std::max((fb_box.y - viewport.y) / 2 - 1, 0),
+                std::min((fb_box.x + fb_box.width - viewport.x + 1) / 2 + 1, half_w),
+                std::min((fb_box.y + fb_box.height - viewport.y + 1) / 2 + 1, half_h)};
+            int w = tile.x2 - tile.x1;
+            int h = tile.y2 - tile.y1;
+            if (w <= 0 || h <= 0) {
+                continue;
+            }
+            
+            if (shelf_x + w > half_w) {
+                shelf_x = 0;
+                shelf_y += shelf_height + 1;
+                shelf_height = 0;
+            }
+            
+            // Full: draw what is packed and start over
+            if (shelf_y + h > half_h) {
+                draw_tiles();
+                shelf_x = shelf_y = shelf_height = 0;
+            }
+            
+            tile.x = shelf_x;
+            tile.y = shelf_y;
+            tiles.push_back(tile);
+            shelf_x += w + 1;
+            shelf_height = std::max(shelf_height, h);
+        }
+        
+        if (!tiles.empty()) {
+            draw_tiles();
+        }
+        
         glBindVertexArray(0);
-        glDeleteBuffers(1, &vbo);
-        glDeleteVertexArrays(1, &vao);
+        return true;
     }
     
     void presentation_feedback(wf::output_t*) override {}
-    void compute_visibility(wf::output_t*, wf::region_t&) override {}
+    void compute_visibility(wf::output_t*, wf::region_t& visible) override {
+        // The glow is translucent, so it never takes anything away from the
+        // visible region of the nodes behind it
+        self->set_visible(!(self->get_glow_region() & visible).empty());
+    }
 };
 
 // Node implementation
 glow_decoration_node_t::glow_decoration_node_t(wayfire_view v) 
     : node_t(false), view(v) {
+    prev_bbox = view->get_bounding_box();
+    
+    on_geometry_changed = [this] (wf::view_geometry_changed_signal*) {
+        handle_geometry_changed();
+    };
+    view->connect(&on_geometry_changed);
 }
 
 void glow_decoration_node_t::set_active(bool active) {
     if (is_active != active) {
+        // Reversing mid-fade continues from the current blend
         is_active = active;
-        auto bbox = get_bounding_box();
-        wf::scene::node_damage_signal ev;
-        ev.region = wf::region_t{bbox};
-        emit(&ev);
+        focus_mix_from = focus_mix;
+        focus_change_time = runtime->get_time();
+    }
+}
+
+bool glow_decoration_node_t::advance_focus_fade(float now) {
+    float target = is_active ? 1.0f : 0.0f;
+    if (focus_mix == target) {
+        return false;
+    }
+    
+    float progress = (now - focus_change_time) / GLOW_FOCUS_FADE_DURATION;
+    if (progress >= 1.0f) {
+        focus_mix = target;
+    } else {
+        focus_mix = focus_mix_from + (target - focus_mix_from) * std::max(progress, 0.0f);
     }
+    
+    return true;
+}
+
+bool glow_decoration_node_t::is_focus_fading() const {
+    return focus_mix != (is_active ? 1.0f : 0.0f);
+}
+
+glm::vec4 glow_decoration_node_t::get_glow_color() {
+    auto& config = runtime->config;
+    return glm::mix(config.inactive_color, config.active_color, focus_mix);
 }
 
 void glow_decoration_node_t::set_animation_time(float time) {
     animation_time = time;
-    auto bbox = get_bounding_box();
+    GLOW_STAT(runtime->stats.tick_damage += region_area(get_glow_region()));
+    damage_glow();
+}
+
+void glow_decoration_node_t::set_visible(bool is_visible) {
+    if (visible == is_visible) {
+        return;
+    }
+    
+    visible = is_visible;
+    if (on_visibility_changed) {
+        on_visibility_changed();
+    }
+}
+
+wf::region_t glow_decoration_node_t::get_glow_region() {
+    if (!view || !view->is_mapped()) {
+        return {};
+    }
+    
+    return compute_glow_region(view->get_bounding_box(), runtime->config);
+}
+
+void glow_decoration_node_t::damage_glow() {
+    wf::scene::node_damage_signal ev;
+    ev.region = get_glow_region();
+    if (!ev.region.empty()) {
+        emit(&ev);
+    }
+}
+
+void glow_decoration_node_t::handle_geometry_changed() {
+    auto bbox = view->get_bounding_box();
+    if (bbox == prev_bbox) {
+        return;
+    }
+    
+    // A move changes every glow pixel, but during a resize the straight
+    // stretches along edges that stay in place look exactly the same
+    auto& config = runtime->config;
     wf::scene::node_damage_signal ev;
-    ev.region = wf::region_t{bbox};
-    emit(&ev);
+    ev.region = compute_glow_region(prev_bbox, config) | compute_glow_region(bbox, config);
+    ev.region ^= compute_stable_glow_region(prev_bbox, bbox, config);
+    prev_bbox = bbox;
+    
+    if (!ev.region.empty()) {
+        emit(&ev);
+    }
+    
+    if (on_box_changed) {
+        on_box_changed();
+    }
 }
 
 std::string glow_decoration_node_t::stringify() const {
@@ -285,15 +1675,7 @@ wf::geometry_t glow_decoration_node_t::get_bounding_box() {
         return {0, 0, 0, 0};
     }
     
-    auto bbox = view->get_bounding_box();
-    int expand = static_cast<int>(g_config.glow_radius + g_config.border_width);
-    
-    return {
-        bbox.x - expand,
-        bbox.y - expand,
-        bbox.width + 2 * expand,
-        bbox.height + 2 * expand
-    };
+    return compute_glow_bounding_box(view->get_bounding_box(), runtime->config);
 }
 
 void glow_decoration_node_t::gen_render_instances(
@@ -310,55 +1692,130 @@ void glow_decoration_node_t::gen_render_instances(
 
 // Plugin implementation
 void glow_decoration_t::update_config() {
-    auto to_vec4 = [](const wf::color_t& c) -> glm::vec4 {
-        return glm::vec4(c.r, c.g, c.b, c.a);
-    };
-    
-    g_config.active_color = to_vec4(opt_active_color);
-    g_config.inactive_color = to_vec4(opt_inactive_color);
-    g_config.glow_radius = opt_glow_radius;
-    g_config.glow_intensity = opt_glow_intensity;
-    g_config.border_width = opt_border_width;
-    g_config.animation_speed = opt_animation_speed;
-    g_config.enable_gradient = opt_enable_gradient;
-    g_config.gradient_angle = opt_gradient_angle;
-    g_config.gradient_color_2 = to_vec4(opt_gradient_color_2);
-    g_config.corner_radius = opt_corner_radius;
-    
     for (auto& [view, node] : decorations) {
         auto bbox = node->get_bounding_box();
         wf::scene::node_damage_signal ev;
         ev.region = wf::region_t{bbox};
         node->emit(&ev);
     }
+    
+    // Speed or feature changes may start (or stop) the animation
+    schedule_animation();
+    update_frame_done_hook();
 }
 
-void glow_decoration_t::update_focus() {
-    for (auto& [view, node] : decorations) {
-        node->set_active(view == focused_view);
+void glow_decoration_t::update_focus(wayfire_view view) {
+    focused_view = view;
+    
+    auto it = decorations.find(view);
+    auto node = (it != decorations.end()) ? it->second.get() : nullptr;
+    if (node == focused_node) {
+        return;
+    }
+    
+    // Only the previously and the newly focused glow change
+    if (focused_node) {
+        focused_node->set_active(false);
     }
+    
+    if (node) {
+        node->set_active(true);
+    }
+    
+    focused_node = node;
+    
+    // The crossfade runs on the animation tick and stops with it
+    schedule_animation();
 }
 
-void glow_decoration_t::update_animation() {
-    auto now = std::chrono::steady_clock::now();
-    float elapsed = std::chrono::duration<float>(now - g_start_time).count();
+void glow_decoration_t::update_visible_list(glow_decoration_node_t *node) {
+    if (node->visible && node->visible_slot < 0) {
+        node->visible_slot = static_cast<int>(visible_nodes.size());
+        visible_nodes.push_back(node);
+        
+        // Resume ticking, the glow catches up from the shared clock
+        schedule_animation();
+    } else if (!node->visible && node->visible_slot >= 0) {
+        auto last = visible_nodes.back();
+        visible_nodes[node->visible_slot] = last;
+        last->visible_slot = node->visible_slot;
+        visible_nodes.pop_back();
+        node->visible_slot = -1;
+    }
+}
+
+bool glow_decoration_t::update_animation() {
+    float elapsed = runtime->get_time();
     
     const float DELAY = 1.0f;
     const float FADE_DURATION = 0.5f;
     
-    for (auto& [view, node] : decorations) {
+    // The shader time stays at 0, and the look static, with animation_speed == 0
+    // or while the quality governor holds the glow static
+    float time = runtime->is_animated() ? elapsed * runtime->config.animation_speed : 0.0f;
+    bool animating = false;
+    
+    // Fade and time are derived from the shared clock, so a hidden glow
+    // simply catches up once it is shown again
+    for (auto node : visible_nodes) {
+        auto& view = node->view;
         if (view && view->is_mapped()) {
-            node->set_animation_time(elapsed * g_config.animation_speed);
-            
             float age = elapsed - node->creation_time;
-            if (age < DELAY) {
-                node->opacity = 0.0f;
-            } else {
+            float opacity = 0.0f;
+            if (age >= DELAY) {
                 float fade_progress = (age - DELAY) / FADE_DURATION;
-                node->opacity = std::min(1.0f, fade_progress);
+                opacity = std::min(1.0f, fade_progress);
+            }
+            
+            bool opacity_changed = (opacity != node->opacity);
+            node->opacity = opacity;
+            bool focus_changed = node->advance_focus_fade(elapsed);
+            
+            if (time != node->animation_time) {
+                node->set_animation_time(time);
+            } else if (opacity_changed || focus_changed) {
+                node->damage_glow();
+            }
+            
+            // Keep ticking while a fade is pending or the look depends on time
+            if (opacity < 1.0f || node->is_focus_fading() ||
+                runtime->is_animated()) {
+                animating = true;
             }
         }
     }
+    
+    return animating;
+}
+
+void glow_decoration_t::schedule_animation() {
+    if (!initialized || animation_hooked) {
+        return;
+    }
+    
+    // Advance with this output's own repaints instead of a free-running timer
+    animation_hooked = true;
+    GLOW_STAT(runtime->stats.animation_wakeups++);
+    output->render->add_effect(&on_frame_pre, wf::OUTPUT_EFFECT_PRE);
+    output->render->schedule_redraw();
+}
+
+void glow_decoration_t::stop_animation() {
+    if (animation_hooked) {
+        output->render->rem_effect(&on_frame_pre);
+        animation_hooked = false;
+    }
+}
+
+void glow_decoration_t::update_frame_done_hook() {
+    bool wanted = initialized && runtime->config.adaptive_quality;
+    if (wanted && !frame_done_hooked) {
+        output->render->add_effect(&on_frame_done, wf::OUTPUT_EFFECT_OVERLAY);
+    } else if (!wanted && frame_done_hooked) {
+        output->render->rem_effect(&on_frame_done);
+    }
+    
+    frame_done_hooked = wanted;
 }
 void glow_decoration_t::add_decoration(wayfire_view view) {
     if (!view || decorations.count(view)) {
@@ -372,51 +1829,127 @@ void glow_decoration_t::add_decoration(wayfire_view view) {
     }
     
     auto node = std::make_shared<glow_decoration_node_t>(view);
-    node->set_active(view == focused_view);
+    if (view == focused_view) {
+        node->set_active(true);
+        focused_node = node.get();
+    }
 
-    // Record creation time using global start
-    auto now = std::chrono::steady_clock::now();
-    node->creation_time = std::chrono::duration<float>(now - g_start_time).count();
+    // Record creation time on the shared clock
+    node->creation_time = runtime->get_time();
     
     auto view_node = view->get_root_node();
     wf::scene::add_front(view_node, node);
     
     decorations[view] = node;
     
+    // Counted as visible until the next visibility pass; this drives the fade-in
+    auto raw_node = node.get();
+    node->on_visibility_changed = [this, raw_node] () {
+        update_visible_list(raw_node);
+    };
+    node->on_box_changed = [this] () {
+        schedule_suspend_update();
+    };
+    node->set_visible(true);
+    
     LOGD("Added glow decoration for: ", view->get_title());
 }
 void glow_decoration_t::remove_decoration(wayfire_view view) {
     auto it = decorations.find(view);
     if (it != decorations.end()) {
-        wf::scene::remove_child(it->second);
+        auto& node = it->second;
+        node->set_visible(false);
+        node->on_visibility_changed = nullptr;
+        node->on_box_changed = nullptr;
+        if (focused_node == node.get()) {
+            focused_node = nullptr;
+        }
+        
+        wf::scene::remove_child(node);
         decorations.erase(it);
     }
     
     if (focused_view == view) {
         focused_view = nullptr;
     }
+    
+    // The glows behind a removed fullscreen view come back
+    schedule_suspend_update();
 }
 
-void glow_decoration_t::init() {
-    update_config();
+void glow_decoration_t::schedule_suspend_update() {
+    idle_update_suspended.run_once([this] () {
+        update_suspended();
+    });
+}
+
+void glow_decoration_t::update_suspended() {
+    auto screen = output->get_relative_geometry();
+    auto covers_screen = [&] (wayfire_toplevel_view view) {
+        if (view->pending_fullscreen()) {
+            return true;
+        }
+        
+        // Borderless "fullscreen" windows that only resized to the output
+        auto geometry = view->get_geometry();
+        return geometry.x <= screen.x && geometry.y <= screen.y &&
+            geometry.x + geometry.width >= screen.x + screen.width &&
+            geometry.y + geometry.height >= screen.y + screen.height;
+    };
     
-    auto reload = [this]() { update_config(); };
+    // Front to back; views elsewhere keep their state until they show up here
+    bool covered = false;
+    auto views = output->wset()->get_views(wf::WSET_CURRENT_WORKSPACE | wf::WSET_MAPPED_ONLY |
+        wf::WSET_EXCLUDE_MINIMIZED | wf::WSET_SORT_STACKING);
+    for (auto& view : views) {
+        bool covers = covers_screen(view);
+        auto it = decorations.find(view);
+        if (it != decorations.end()) {
+            set_suspended(it->second.get(), covered || covers);
+        }
+        
+        covered |= covers;
+    }
+}
+
+void glow_decoration_t::set_suspended(glow_decoration_node_t *node, bool suspended) {
+    if (node->suspended == suspended) {
+        return;
+    }
     
-    opt_active_color.set_callback(reload);
-    opt_inactive_color.set_callback(reload);
-    opt_glow_radius.set_callback(reload);
-    opt_glow_intensity.set_callback(reload);
-    opt_border_width.set_callback(reload);
-    opt_animation_speed.set_callback(reload);
-    opt_enable_gradient.set_callback(reload);
-    opt_gradient_angle.set_callback(reload);
-    opt_gradient_color_2.set_callback(reload);
-    opt_corner_radius.set_callback(reload);
+    node->suspended = suspended;
+    if (suspended) {
+        // Repaint its pixels without the glow while the render instances still exist
+        node->damage_glow();
+        node->set_visible(false);
+        wf::scene::set_node_enabled(node->shared_from_this(), false);
+        LOGD("Suspended glow decoration for: ", node->view->get_title());
+    } else {
+        // Ticking resumes from the shared clock, so the look is where it would be
+        wf::scene::set_node_enabled(node->shared_from_this(), true);
+        node->set_visible(true);
+        node->damage_glow();
+        LOGD("Resumed glow decoration for: ", node->view->get_title());
+    }
+}
+
+void glow_decoration_t::init() {
+    runtime->register_instance(this);
+    
+    // Build the programs now rather than in the first frame
+    OpenGL::render_begin();
+    runtime->prepare_programs();
+    OpenGL::render_end();
     
+    // Views without a glow, e.g. client-decorated ones, can still cover the
+    // output, so every map re-evaluates the suspended glows (unmaps do so in
+    // remove_decoration())
     on_view_mapped = [this](wf::view_mapped_signal *ev) {
         if (toplevel_cast(ev->view)) {
             add_decoration(ev->view);
         }
+        
+        schedule_suspend_update();
     };
     output->connect(&on_view_mapped);
     
@@ -426,43 +1959,90 @@ void glow_decoration_t::init() {
     output->connect(&on_view_unmapped);
     
     on_focus_request = [this](wf::view_focus_request_signal *ev) {
-        focused_view = ev->view;
-        update_focus();
+        update_focus(ev->view);
+        
+        // Focus also raises the view
+        schedule_suspend_update();
     };
     output->connect(&on_focus_request);
     
+    on_fullscreen = [this](wf::view_fullscreen_signal*) {
+        schedule_suspend_update();
+    };
+    output->connect(&on_fullscreen);
+    
+    on_minimized = [this](wf::view_minimized_signal*) {
+        schedule_suspend_update();
+    };
+    output->connect(&on_minimized);
+    
+    on_view_workspace_changed = [this](wf::view_change_workspace_signal*) {
+        schedule_suspend_update();
+    };
+    output->connect(&on_view_workspace_changed);
+    
+    // Re-index right away instead of waiting for the next visibility pass,
+    // which then refines the result with occlusion
+    on_workspace_changed = [this](wf::workspace_changed_signal*) {
+        wf::region_t screen{output->get_relative_geometry()};
+        for (auto& [view, node] : decorations) {
+            node->set_visible(!node->suspended && !(node->get_glow_region() & screen).empty());
+        }
+        
+        schedule_suspend_update();
+    };
+    output->connect(&on_workspace_changed);
+    
     for (auto& view : wf::get_core().get_all_views()) {
         if (view->get_output() == output && toplevel_cast(view)) {
             add_decoration(view);
         }
     }
     
-    auto loop = wl_display_get_event_loop(wf::get_core().display);
-    animation_timer = wl_event_loop_add_timer(loop, [](void *data) -> int {
-        auto self = static_cast<glow_decoration_t*>(data);
-        self->update_animation();
-        wl_event_source_timer_update(self->animation_timer, 16);
-        return 0;
-    }, this);
-    wl_event_source_timer_update(animation_timer, 16);
+    schedule_suspend_update();
+    
+    // Runs at the start of every frame on this output, so time is sampled once
+    // per actual repaint and follows the output's refresh rate
+    on_frame_pre = [this]() {
+        GLOW_STAT(auto tick_start = std::chrono::steady_clock::now());
+        bool animating = update_animation();
+        GLOW_STAT(runtime->stats.end_tick(glow_elapsed_us(tick_start)));
+        if (animating) {
+            output->render->schedule_redraw();
+        } else {
+            stop_animation();
+        }
+    };
+    
+    // Runs after the scene was rendered on this output, closing the frame
+    // for the quality governor. Never schedules a repaint by itself.
+    on_frame_done = [this]() {
+        runtime->frame_done(output);
+    };
+    
+    initialized = true;
+    schedule_animation();
+    update_frame_done_hook();
     
     LOGI("Glow decoration plugin initialized");
 }
 
 void glow_decoration_t::fini() {
-    if (animation_timer) {
-        wl_event_source_remove(animation_timer);
-        animation_timer = nullptr;
-    }
+    stop_animation();
+    idle_update_suspended.disconnect();
+    initialized = false;
+    update_frame_done_hook();
     
     for (auto& [view, node] : decorations) {
+        node->on_visibility_changed = nullptr;
         wf::scene::remove_child(node);
     }
     decorations.clear();
+    visible_nodes.clear();
+    focused_node = nullptr;
     
-    if (g_glow_program.compiled) {
-        g_glow_program.destroy();
-    }
+    // The shared program stays alive until the last output lets go of the runtime
+    runtime->unregister_instance(this);
     
     LOGI("Glow decoration plugin finalized");
 }
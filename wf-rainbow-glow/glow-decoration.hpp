@@ -6,58 +6,348 @@
 #include <wayfire/scene.hpp>
 #include <wayfire/signal-definitions.hpp>
 #include <wayfire/per-output-plugin.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/plugins/common/shared-core-data.hpp>
 #include <GLES3/gl3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <array>
+#include <cstdint>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <vector>
+#include <functional>
 #include <memory>
 #include <chrono>
 
+#include "glow-render.hpp"
+#include "glow-stats.hpp"
+
+#ifdef GLOW_STATS
+#include <wayfire/plugins/ipc/ipc-method-repository.hpp>
+#endif
+
 namespace wf {
 namespace glow_decoration {
 
-struct glow_program_t {
-    GLuint program = 0;
-    GLuint vertex_shader = 0;
-    GLuint fragment_shader = 0;
-    bool compiled = false;
-    
-    // Uniform locations
-    GLint u_resolution = -1;
-    GLint u_border_box = -1;
-    GLint u_glow_color = -1;
-    GLint u_glow_color_2 = -1;
-    GLint u_glow_radius = -1;
-    GLint u_glow_intensity = -1;
-    GLint u_border_width = -1;
-    GLint u_time = -1;
-    GLint u_enable_gradient = -1;
-    GLint u_gradient_angle = -1;
-    GLint u_corner_radius = -1;
-    
-    bool compile_shader(GLuint shader, const char* source);
-    bool link_program();
-    bool compile_shaders();
-    void use();
+// Everything that changes the baked glow shape; colour and intensity are
+// applied when sampling so focused and unfocused windows share entries
+struct glow_atlas_key_t {
+    float glow_radius;
+    float border_width;
+    float corner_radius;
+    
+    bool operator<(const glow_atlas_key_t& other) const {
+        if (glow_radius != other.glow_radius) return glow_radius < other.glow_radius;
+        if (border_width != other.border_width) return border_width < other.border_width;
+        return corner_radius < other.corner_radius;
+    }
+};
+
+// One corner tile (size x size) with the edge profile in the row right below it
+struct glow_atlas_entry_t {
+    int x = 0;
+    int y = 0;
+    int size = 0;
+};
+
+/**
+ * Offscreen cache of baked glow shapes. Each entry holds the falloff of one
+ * corner plus a straight edge, rendered once per unique shape into a shared
+ * atlas texture; windows then draw their glow by mirrored 9-slice sampling.
+ */
+struct glow_texture_cache_t {
+    static constexpr int ATLAS_SIZE = 512;
+    
+    GLuint texture = 0;
+    GLuint framebuffer = 0;
+    glow_program_t bake_program;
+    glow_program_t sample_program;
+    glow_program_cache_t *program_cache = nullptr;
+    
+    // Atlas and its programs; also called ahead of the first lookup so that
+    // the first frame does not wait for the compiler
+    bool create_resources();
+    
+    // Returns nullptr when the window is too small for an unclamped corner
+    // or the shape cannot be baked; callers then fall back to the analytic shader
+    const glow_atlas_entry_t* lookup(const glow_config_t& config,
+        const wf::geometry_t& view_box, const glow_geometry_t& geometry);
+    void invalidate();
+    void destroy();
+    
+  private:
+    std::map<glow_atlas_key_t, glow_atlas_entry_t> entries;
+    int shelf_x = 0;
+    int shelf_y = 0;
+    int shelf_height = 0;
+    bool broken = false;
+    
+    bool allocate(int size, glow_atlas_entry_t& entry);
+    void bake(const glow_atlas_key_t& key, const glow_atlas_entry_t& entry,
+        const glow_geometry_t& geometry);
+};
+
+/**
+ * Scratch target for the half-resolution falloff pass. Glows are drawn one
+ * after another on every output, so a single buffer serves all of them; it
+ * only grows, to the largest half-size viewport seen so far.
+ */
+struct glow_half_res_buffer_t {
+    GLuint texture = 0;
+    GLuint framebuffer = 0;
+    int width = 0;
+    int height = 0;
+    
+    bool ensure(int min_width, int min_height);
+    void destroy();
+};
+
+// Quality tiers of the adaptive governor, from full quality to cheapest
+enum glow_quality_tier_t : int {
+    GLOW_TIER_FULL          = 0,
+    GLOW_TIER_NO_EDGE_NOISE = 1,
+    GLOW_TIER_NO_WOBBLE     = 2,
+    GLOW_TIER_HALF_RES      = 3,  // falloff at half resolution
+    GLOW_TIER_STATIC        = 4,  // atlas ring in the base colour, not animated
+};
+
+// Timer queries still waiting for their result; further draws go untimed
+// and are counted at the mean GPU time of the timed ones
+constexpr size_t GLOW_MAX_PENDING_QUERIES = 16;
+
+/**
+ * Measures what the glow costs per output frame - CPU time spent in render()
+ * plus GPU time from EXT_disjoint_timer_query where the driver has it - and
+ * steps the quality tier down while that exceeds its share of the frame
+ * budget, and back up once there is headroom again. Every output is measured
+ * against its own refresh rate; the tier is shared, so one output over its
+ * budget lowers it and all of them need headroom to raise it.
+ */
+class glow_governor_t {
+  public:
+    int tier = GLOW_TIER_FULL;
+    
+    // Brackets the GL work of one render() call on an output
+    void begin_draw(wf::output_t *output);
+    void end_draw();
+    
+    // Closes the frame just rendered on the output. Returns true if the tier changed.
+    bool frame_done(wf::output_t *output, float budget_ms, const glow_config_t& config);
+    
+    // Forgets an output that is going away
+    void remove_output(wf::output_t *output);
+    
+    // Back to full quality with no history, for when adaptive quality is turned off
+    void reset();
     void destroy();
+    
+  private:
+    // Draws of an output since its last frame_done(), and its recent history
+    struct output_cost_t {
+        double cpu_ms = 0.0;
+        double gpu_ms = 0.0;
+        int frame_draws = 0;
+        int timed_draws = 0;             // query results in gpu_ms
+        double gpu_ms_per_draw = 0.0;    // mean of the last results
+        int frames_over = 0;
+        int frames_under = 0;
+        bool over_budget = false;        // in its last frame
+    };
+    
+    struct pending_query_t {
+        GLuint query;
+        wf::output_t *output;
+    };
+    
+    std::unordered_map<wf::output_t*, output_cost_t> outputs;
+    wf::output_t *draw_output = nullptr;
+    std::chrono::steady_clock::time_point draw_start;
+    bool measuring = false;
+    
+    bool gpu_timer_checked = false;
+    bool gpu_timer = false;
+    GLuint active_query = 0;
+    std::vector<GLuint> free_queries;
+    std::vector<pending_query_t> pending_queries;
+    
+    void collect_gpu_times();
+    bool set_tier(int new_tier);
 };
 
-struct glow_config_t {
-    glm::vec4 active_color{1.0f, 0.5f, 0.0f, 1.0f};
-    glm::vec4 inactive_color{0.3f, 0.3f, 0.3f, 1.0f};
-    glm::vec4 gradient_color_2{0.0f, 0.5f, 1.0f, 1.0f};
-    float glow_radius = 20.0f;
-    float glow_intensity = 1.0f;
-    float border_width = 2.0f;
-    float animation_speed = 1.0f;
-    bool enable_gradient = false;
-    float gradient_angle = 45.0f;
-    float corner_radius = 10.0f;
+class glow_decoration_t;
+
+// How often background shader builds are checked for completion
+constexpr uint32_t GLOW_BUILD_POLL_MS = 16;
+
+/**
+ * Process-wide glow state shared by every per-output instance: the compiled
+ * program and its GPU buffers, the animation clock and the configuration.
+ * Held through wf::shared_data::ref_ptr_t, so it is created with the first
+ * output and released with the last one - unplugging an output does not
+ * force a shader recompile.
+ */
+class glow_runtime_t : public wf::custom_data_t {
+  public:
+    glow_geometry_t geometry;
+    glow_texture_cache_t texture_cache;
+    glow_config_t config;
+    glow_governor_t governor;
+    glow_half_res_buffer_t half_res_buffer;
+#ifdef GLOW_STATS
+    glow_stats_t stats;
+#endif
+    
+    // Uniform buffer holding glow_config_block_t, re-uploaded only after a
+    // reload or when drawing into an output of another scale or transform
+    GLuint config_ubo = 0;
+    
+    glow_runtime_t();
+    ~glow_runtime_t();
+    
+    // Create the ring geometry and config uniform buffer on first use
+    bool init_gl_resources();
+    
+    /**
+     * Start building every program the configuration may use, down to the
+     * lowest quality tier the governor may pick, so no frame waits for the
+     * compiler. Needs the context current. Builds the driver compiles in the
+     * background are collected from a timer.
+     */
+    void prepare_programs();
+    
+    /**
+     * The configuration in the device pixels of a render target: radii scaled
+     * by its output scale and capped at max_device_radius, the gradient angle
+     * turned with its transform. Kept for the last target drawn into.
+     */
+    const glow_config_t& get_device_config(const wf::render_target_t& target);
+    
+    // Bind the config uniform buffer for drawing into the target, uploading
+    // it first if its device config changed
+    void bind_config_block(const wf::render_target_t& target);
+    
+    // Uniform uploads issued and avoided by all glow programs so far
+    void get_uniform_stats(uint64_t& uploads, uint64_t& skipped) const;
+    
+    // Program specialized for the feature mask, built now unless prepared.
+    // Returns nullptr if the variant failed to build.
+    glow_program_t* get_program(uint32_t features);
+    
+    // Seconds since the runtime was created, shared by all outputs
+    float get_time() const;
+    
+    // The configuration as reduced by the quality governor, now or at a tier
+    uint32_t get_features() const;
+    uint32_t get_features(int tier) const;
+    bool use_static_glow() const;
+    bool use_half_resolution() const;
+    bool is_animated() const;
+    
+    // Called by each output after it rendered a frame
+    void frame_done(wf::output_t *output);
+    
+    // Output instances are notified when the configuration changes
+    void register_instance(glow_decoration_t *instance);
+    void unregister_instance(glow_decoration_t *instance);
+    
+  private:
+    wf::option_wrapper_t<wf::color_t> opt_active_color{"glow-decoration/active_color"};
+    wf::option_wrapper_t<wf::color_t> opt_inactive_color{"glow-decoration/inactive_color"};
+    wf::option_wrapper_t<double> opt_glow_radius{"glow-decoration/glow_radius"};
+    wf::option_wrapper_t<double> opt_glow_intensity{"glow-decoration/glow_intensity"};
+    wf::option_wrapper_t<double> opt_border_width{"glow-decoration/border_width"};
+    wf::option_wrapper_t<double> opt_animation_speed{"glow-decoration/animation_speed"};
+    wf::option_wrapper_t<bool> opt_enable_gradient{"glow-decoration/enable_gradient"};
+    wf::option_wrapper_t<double> opt_gradient_angle{"glow-decoration/gradient_angle"};
+    wf::option_wrapper_t<wf::color_t> opt_gradient_color_2{"glow-decoration/gradient_color_2"};
+    wf::option_wrapper_t<double> opt_corner_radius{"glow-decoration/corner_radius"};
+    wf::option_wrapper_t<double> opt_max_device_radius{"glow-decoration/max_device_radius"};
+    wf::option_wrapper_t<bool> opt_batch_rendering{"glow-decoration/batch_rendering"};
+    wf::option_wrapper_t<bool> opt_half_resolution{"glow-decoration/half_resolution"};
+    wf::option_wrapper_t<bool> opt_merge_glows{"glow-decoration/merge_glows"};
+    wf::option_wrapper_t<bool> opt_adaptive_quality{"glow-decoration/adaptive_quality"};
+    wf::option_wrapper_t<double> opt_quality_budget_high{"glow-decoration/quality_budget_high"};
+    wf::option_wrapper_t<double> opt_quality_budget_low{"glow-decoration/quality_budget_low"};
+    wf::option_wrapper_t<int> opt_quality_downgrade_frames{"glow-decoration/quality_downgrade_frames"};
+    wf::option_wrapper_t<int> opt_quality_upgrade_frames{"glow-decoration/quality_upgrade_frames"};
+    wf::option_wrapper_t<int> opt_lowest_quality_tier{"glow-decoration/lowest_quality_tier"};
+    
+    std::chrono::steady_clock::time_point start_time;
+    std::vector<glow_decoration_t*> instances;
+    
+    uint64_t config_serial = 1;
+    uint64_t uploaded_config_serial = 0;
+    
+    // get_device_config() of the last target, and what it was derived from
+    glow_config_t device_config;
+    uint64_t device_config_serial = 0;
+    uint64_t device_source_serial = 0;
+    float device_scale = 0.0f;
+    wl_output_transform device_transform = WL_OUTPUT_TRANSFORM_NORMAL;
+    
+    // Programs by feature mask, added as they are first started
+    std::unordered_map<uint32_t, glow_program_t> variants;
+    std::unordered_set<uint32_t> failed_variants;
+    
+    // Linked binaries under $XDG_CACHE_HOME/wayfire/glow-decoration
+    glow_program_cache_t program_cache;
+    
+    // Variants started by prepare_programs() and not finished yet
+    std::vector<uint32_t> pending_builds;
+    wf::wl_timer build_timer;
+    
+    void load_config();
+    void start_program(uint32_t features);
+    bool finish_program(uint32_t features);
+    void finish_ready_programs();
+    
+#ifdef GLOW_STATS
+    // glow-decoration/stats returns the counters, glow-decoration/reset-stats clears them
+    wf::shared_data::ref_ptr_t<wf::ipc::method_repository_t> ipc_repo;
+    wf::ipc::method_callback ipc_get_stats;
+    wf::ipc::method_callback ipc_reset_stats;
+    nlohmann::json stats_to_json();
+#endif
 };
 
-extern glow_program_t g_glow_program;
-extern glow_config_t g_config;
+// Ring around a box, in the coordinates of the box and config (layout or device pixels)
+inline glow_ring_t compute_glow_ring(const wf::geometry_t& view_box, const glow_config_t& config,
+    bool border_only = false) {
+    return compute_glow_ring(view_box.x, view_box.y, view_box.width, view_box.height,
+        config, border_only);
+}
+
+// Damage bounds of the glow around a view box: the expanded box without the hollow centre
+wf::geometry_t compute_glow_bounding_box(const wf::geometry_t& view_box, const glow_config_t& config);
+wf::region_t compute_glow_region(const wf::geometry_t& view_box, const glow_config_t& config);
+
+// Hollow centre of the ring, where no glow pixel is ever drawn
+wf::region_t compute_glow_centre(const wf::geometry_t& view_box, const glow_config_t& config);
+
+/**
+ * Pixels that look the same around both view boxes: the straight stretch of
+ * every edge that did not move, as long as the look depends only on the
+ * distance to the box. Used to trim damage while a window is resized.
+ */
+wf::region_t compute_stable_glow_region(const wf::geometry_t& old_box,
+    const wf::geometry_t& new_box, const glow_config_t& config);
+
+// Above this many scissor boxes a single draw over the damage extents is cheaper
+constexpr size_t GLOW_MAX_SCISSOR_BOXES = 16;
+
+/**
+ * Coalesce the boxes of a damage region into as few scissor rectangles as possible.
+ * Returns false if the result would exceed GLOW_MAX_SCISSOR_BOXES.
+ */
+bool merge_damage_boxes(const wf::region_t& damage, std::vector<wlr_box>& out);
+
+// Seconds a glow takes to blend between the inactive and the active look
+constexpr float GLOW_FOCUS_FADE_DURATION = 0.25f;
 
 /**
  * The glow decoration render node.
@@ -69,23 +359,63 @@ class glow_decoration_node_t : public wf::scene::node_t {
     wayfire_view view;
     bool is_active = false;
     float animation_time = 0.0f;
+    
+    // Blend between inactive (0) and active (1) colour, eased on the shared clock
+    float focus_mix = 0.0f;
+    float focus_mix_from = 0.0f;
+    float focus_change_time = 0.0f;
 
     // In glow_decoration_node_t class
 float opacity = 0.0f;           // Current opacity (0-1)
 float creation_time = 0.0f;     // When this decoration was created
 bool fade_started = false;      // Has the fade begun?
     
-    // Track previous bounding box for damage when geometry changes
+    // View bounding box the glow was last damaged for
     wf::geometry_t prev_bbox{0, 0, 0, 0};
     
     // Signal connection for geometry changes
     wf::signal::connection_t<wf::view_geometry_changed_signal> on_geometry_changed;
     
+    wf::shared_data::ref_ptr_t<glow_runtime_t> runtime;
+    
+    // Whether any glow pixel was on screen in the last visibility pass.
+    // Hidden glows are skipped by the animation tick.
+    bool visible = false;
+    
+    // Index in the owner's list of visible glows, -1 while hidden
+    int visible_slot = -1;
+    
+    // Called after every visibility change, so the owner can re-index the glow
+    std::function<void()> on_visibility_changed;
+    
+    // Disabled while its view is fullscreen or behind a view covering the output
+    bool suspended = false;
+    
+    // Called after the view's box changed, so the owner can check what it covers
+    std::function<void()> on_box_changed;
+    
     glow_decoration_node_t(wayfire_view v);
     
+    // Starts the focus crossfade; the animation tick advances it
     void set_active(bool active);
     void set_animation_time(float time);
     
+    // Moves focus_mix towards its target, landing on it exactly once the fade
+    // is over. Returns whether the value changed.
+    bool advance_focus_fade(float now);
+    bool is_focus_fading() const;
+    
+    // Inactive/active colour blend, without the fade-in opacity
+    glm::vec4 get_glow_color();
+    void set_visible(bool is_visible);
+    
+    // Glow pixels only: the bounding box minus the window interior
+    wf::region_t get_glow_region();
+    void damage_glow();
+    
+    // Damages the old and new rings, minus what a resize leaves unchanged
+    void handle_geometry_changed();
+    
     std::string stringify() const override;
     wf::geometry_t get_bounding_box() override;
     void gen_render_instances(
@@ -99,31 +429,57 @@ class glow_decoration_t : public wf::per_output_plugin_instance_t {
     void init() override;
     void fini() override;
     
+    // Called by the runtime after it reloaded the shared configuration
+    void update_config();
+    
   private:
-    wf::option_wrapper_t<wf::color_t> opt_active_color{"glow-decoration/active_color"};
-    wf::option_wrapper_t<wf::color_t> opt_inactive_color{"glow-decoration/inactive_color"};
-    wf::option_wrapper_t<double> opt_glow_radius{"glow-decoration/glow_radius"};
-    wf::option_wrapper_t<double> opt_glow_intensity{"glow-decoration/glow_intensity"};
-    wf::option_wrapper_t<double> opt_border_width{"glow-decoration/border_width"};
-    wf::option_wrapper_t<double> opt_animation_speed{"glow-decoration/animation_speed"};
-    wf::option_wrapper_t<bool> opt_enable_gradient{"glow-decoration/enable_gradient"};
-    wf::option_wrapper_t<double> opt_gradient_angle{"glow-decoration/gradient_angle"};
-    wf::option_wrapper_t<wf::color_t> opt_gradient_color_2{"glow-decoration/gradient_color_2"};
-    wf::option_wrapper_t<double> opt_corner_radius{"glow-decoration/corner_radius"};
+    wf::shared_data::ref_ptr_t<glow_runtime_t> runtime;
+    
+    // Handle table for lifecycle and focus lookups
+    std::unordered_map<wayfire_view, std::shared_ptr<glow_decoration_node_t>> decorations;
+    
+    // Dense list of the glows currently on screen; only these are ticked
+    std::vector<glow_decoration_node_t*> visible_nodes;
     
-    std::map<wayfire_view, std::shared_ptr<glow_decoration_node_t>> decorations;
     wayfire_view focused_view = nullptr;
-    wl_event_source *animation_timer = nullptr;
+    glow_decoration_node_t *focused_node = nullptr;
+    wf::effect_hook_t on_frame_pre;
+    wf::effect_hook_t on_frame_done;
+    bool animation_hooked = false;
+    bool frame_done_hooked = false;
+    bool initialized = false;
     
     wf::signal::connection_t<wf::view_mapped_signal> on_view_mapped;
     wf::signal::connection_t<wf::view_unmapped_signal> on_view_unmapped;
     wf::signal::connection_t<wf::view_focus_request_signal> on_focus_request;
+    wf::signal::connection_t<wf::workspace_changed_signal> on_workspace_changed;
+    wf::signal::connection_t<wf::view_fullscreen_signal> on_fullscreen;
+    wf::signal::connection_t<wf::view_minimized_signal> on_minimized;
+    wf::signal::connection_t<wf::view_change_workspace_signal> on_view_workspace_changed;
     
-    void update_config();
-    void update_focus();
-    void update_animation();
+    // Coalesces the events that may change which glows are suspended
+    wf::wl_idle_call idle_update_suspended;
+    
+    void update_focus(wayfire_view view);
+    void update_visible_list(glow_decoration_node_t *node);
+    bool update_animation();
+    void schedule_animation();
+    void stop_animation();
+    
+    // Overlay hooks keep the output from scanning out directly, so the
+    // governor's frame-end hook is only installed while it is in use
+    void update_frame_done_hook();
     void add_decoration(wayfire_view view);
     void remove_decoration(wayfire_view view);
+    
+    /**
+     * Fullscreen and output-covering views on the current workspace, and
+     * every view stacked behind one, have their glow node disabled, so it
+     * neither draws nor damages nor ticks and direct scanout can engage.
+     */
+    void schedule_suspend_update();
+    void update_suspended();
+    void set_suspended(glow_decoration_node_t *node, bool suspended);
 };
 
 } // namespace glow_decoration
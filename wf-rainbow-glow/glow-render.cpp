@@ -0,0 +1,591 @@
+#include "glow-render.hpp"
+#include "glow-stats.hpp"
+#include "shaders.hpp"
+
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
+namespace wf {
+namespace glow_decoration {
+
+// Shader compilation
+bool glow_program_t::check_shader(GLuint shader) {
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    
+    if (!success) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        error_log = std::string("shader compile error: ") + log;
+        return false;
+    }
+    return true;
+}
+
+bool glow_program_t::check_link() {
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    
+    if (!success) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        error_log = std::string("program link error: ") + log;
+        return false;
+    }
+    return true;
+}
+
+bool glow_program_t::compile_shaders(const char *vertex_source, const char *fragment_source) {
+    if (compiled) return true;
+    return start_build(vertex_source, fragment_source) && finish_build();
+}
+
+bool glow_program_t::start_build(const char *vertex_source, const char *fragment_source) {
+    vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    program = glCreateProgram();
+    if (!vertex_shader || !fragment_shader || !program) {
+        error_log = "cannot create shader objects";
+        return false;
+    }
+    
+    // No status queries here: they would wait for the compiler
+    glShaderSource(vertex_shader, 1, &vertex_source, nullptr);
+    glShaderSource(fragment_shader, 1, &fragment_source, nullptr);
+    glCompileShader(vertex_shader);
+    glCompileShader(fragment_shader);
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    
+    building = true;
+    return true;
+}
+
+bool glow_program_t::finish_build() {
+    building = false;
+    if (!check_shader(vertex_shader) || !check_shader(fragment_shader) || !check_link()) {
+        return false;
+    }
+    
+    // The linked program keeps the code; the shader objects are no longer needed
+    glDetachShader(program, vertex_shader);
+    glDetachShader(program, fragment_shader);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    vertex_shader = fragment_shader = 0;
+    
+    init_program();
+    return true;
+}
+
+bool glow_program_t::load_binary(GLenum format, const std::vector<uint8_t>& binary) {
+    program = glCreateProgram();
+    if (!program) {
+        return false;
+    }
+    
+    glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        program = 0;
+        return false;
+    }
+    
+    init_program();
+    return true;
+}
+
+bool glow_program_t::get_binary(GLenum& format, std::vector<uint8_t>& binary) const {
+    if (!compiled) {
+        return false;
+    }
+    
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return false;
+    }
+    
+    binary.resize(length);
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    binary.resize(std::max(length, 0));
+    return !binary.empty();
+}
+
+void glow_program_t::init_program() {
+    u_resolution = glGetUniformLocation(program, "u_resolution");
+    u_x_stops = glGetUniformLocation(program, "u_x_stops");
+    u_y_stops = glGetUniformLocation(program, "u_y_stops");
+    u_border_box = glGetUniformLocation(program, "u_border_box");
+    u_glow_color = glGetUniformLocation(program, "u_glow_color");
+    u_glow_color_2 = glGetUniformLocation(program, "u_glow_color_2");
+    u_glow_radius = glGetUniformLocation(program, "u_glow_radius");
+    u_glow_intensity = glGetUniformLocation(program, "u_glow_intensity");
+    u_border_width = glGetUniformLocation(program, "u_border_width");
+    u_time = glGetUniformLocation(program, "u_time");
+    u_gradient_angle = glGetUniformLocation(program, "u_gradient_angle");
+    u_corner_radius = glGetUniformLocation(program, "u_corner_radius");
+    u_atlas = glGetUniformLocation(program, "u_atlas");
+    u_atlas_size = glGetUniformLocation(program, "u_atlas_size");
+    u_atlas_tile = glGetUniformLocation(program, "u_atlas_tile");
+    u_tile_origin = glGetUniformLocation(program, "u_tile_origin");
+    u_half_res = glGetUniformLocation(program, "u_half_res");
+    u_half_res_map = glGetUniformLocation(program, "u_half_res_map");
+    u_box_count = glGetUniformLocation(program, "u_box_count");
+    u_boxes = glGetUniformLocation(program, "u_boxes");
+    u_box_colors = glGetUniformLocation(program, "u_box_colors");
+    u_box_colors_2 = glGetUniformLocation(program, "u_box_colors_2");
+    u_box_times = glGetUniformLocation(program, "u_box_times");
+    
+    GLuint config_block = glGetUniformBlockIndex(program, "GlowConfig");
+    if (config_block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, config_block, GLOW_CONFIG_BINDING);
+    }
+    
+    compiled = true;
+}
+
+void glow_program_t::use() {
+    glUseProgram(program);
+}
+
+void glow_program_t::destroy() {
+    if (program) glDeleteProgram(program);
+    if (vertex_shader) glDeleteShader(vertex_shader);
+    if (fragment_shader) glDeleteShader(fragment_shader);
+    program = vertex_shader = fragment_shader = 0;
+    compiled = building = false;
+    shadow.clear();
+}
+
+bool glow_program_t::shadow_matches(GLint location, const float (&v)[4]) {
+    if (location >= static_cast<GLint>(shadow.size())) {
+        shadow.resize(location + 1);
+    }
+    
+    auto& entry = shadow[location];
+    if (entry.valid && std::equal(v, v + 4, entry.v)) {
+        uniform_uploads_skipped++;
+        return true;
+    }
+    
+    entry.valid = true;
+    std::copy(v, v + 4, entry.v);
+    uniform_uploads++;
+    return false;
+}
+
+void glow_program_t::set_uniform(GLint location, float x) {
+    if (location < 0 || shadow_matches(location, {x, 0.0f, 0.0f, 0.0f})) return;
+    glUniform1f(location, x);
+}
+
+void glow_program_t::set_uniform(GLint location, float x, float y) {
+    if (location < 0 || shadow_matches(location, {x, y, 0.0f, 0.0f})) return;
+    glUniform2f(location, x, y);
+}
+
+void glow_program_t::set_uniform(GLint location, float x, float y, float z) {
+    if (location < 0 || shadow_matches(location, {x, y, z, 0.0f})) return;
+    glUniform3f(location, x, y, z);
+}
+
+void glow_program_t::set_uniform(GLint location, float x, float y, float z, float w) {
+    if (location < 0 || shadow_matches(location, {x, y, z, w})) return;
+    glUniform4f(location, x, y, z, w);
+}
+
+void glow_program_t::set_uniform(GLint location, const glm::vec4& v) {
+    set_uniform(location, v[0], v[1], v[2], v[3]);
+}
+
+void glow_program_t::set_uniform_int(GLint location, int v) {
+    if (location < 0 || shadow_matches(location, {float(v), 0.0f, 0.0f, 0.0f})) return;
+    glUniform1i(location, v);
+}
+
+// Program binary cache
+static constexpr char GLOW_CACHE_MAGIC[8] = {'W', 'F', 'G', 'L', 'O', 'W', '1', '\0'};
+
+// Header of a cache file; the binary follows it
+struct glow_cache_header_t {
+    char magic[8];
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+};
+
+// 64-bit FNV-1a; strings are separated by their terminating zero
+static uint64_t hash_strings(std::initializer_list<const std::string*> strings) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (auto string : strings) {
+        for (size_t i = 0; i <= string->size(); i++) {
+            hash = (hash ^ static_cast<uint8_t>(string->c_str()[i])) * 0x100000001b3ull;
+        }
+    }
+    
+    return hash;
+}
+
+void glow_program_cache_t::check_driver() {
+    if (driver_checked) return;
+    driver_checked = true;
+    
+    auto get_string = [] (GLenum name) {
+        auto value = reinterpret_cast<const char*>(glGetString(name));
+        return std::string(value ? value : "");
+    };
+    
+    driver = get_string(GL_VENDOR) + '\n' + get_string(GL_RENDERER) + '\n' +
+        get_string(GL_VERSION) + '\n' + get_string(GL_SHADING_LANGUAGE_VERSION);
+    
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+    binary_formats.resize(std::max(count, 0));
+    if (count > 0) {
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, binary_formats.data());
+    }
+    
+    auto extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    parallel_compile = extensions && std::strstr(extensions, "GL_KHR_parallel_shader_compile");
+    if (parallel_compile) {
+        // As many compiler threads as the driver is willing to use
+        auto set_threads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(
+            eglGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+        if (set_threads) {
+            set_threads(0xffffffffu);
+        }
+    }
+}
+
+std::string glow_program_cache_t::entry_path(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return directory + "/" + name;
+}
+
+bool glow_program_cache_t::start(glow_program_t& program, const std::string& vertex_source,
+    const std::string& fragment_source) {
+    auto start_time = std::chrono::steady_clock::now();
+    check_driver();
+    program.cache_key = hash_strings({&driver, &vertex_source, &fragment_source});
+    
+    bool use_disk = !directory.empty() && !binary_formats.empty();
+    if (use_disk) {
+        auto path = entry_path(program.cache_key);
+        std::error_code error;
+        auto file_size = std::filesystem::file_size(path, error);
+        std::ifstream file(path, std::ios::binary);
+        glow_cache_header_t header;
+        if (!error && file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            // The header is checked before anything is allocated for the
+            // binary, so a damaged entry cannot ask for gigabytes
+            bool valid = !std::memcmp(header.magic, GLOW_CACHE_MAGIC, sizeof(header.magic)) &&
+                header.key == program.cache_key && header.length > 0 &&
+                file_size >= sizeof(header) && header.length <= file_size - sizeof(header) &&
+                std::count(binary_formats.begin(), binary_formats.end(), GLint(header.format));
+            
+            std::vector<uint8_t> binary;
+            if (valid) {
+                binary.resize(header.length);
+                valid = !!file.read(reinterpret_cast<char*>(binary.data()), binary.size());
+            }
+            
+            if (valid && program.load_binary(header.format, binary)) {
+                program.build_us = glow_elapsed_us(start_time);
+                hits++;
+                return true;
+            }
+            
+            // Stale or corrupt: build from source and write it again
+            file.close();
+            std::remove(path.c_str());
+        }
+    }
+    
+    misses++;
+    bool started = program.start_build(vertex_source.c_str(), fragment_source.c_str());
+    program.build_us = glow_elapsed_us(start_time);
+    return started;
+}
+
+bool glow_program_cache_t::is_ready(const glow_program_t& program) {
+    if (!program.building || !parallel_compile) {
+        return true;
+    }
+    
+    GLint done = GL_FALSE;
+    glGetProgramiv(program.program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+bool glow_program_cache_t::finish(glow_program_t& program) {
+    if (!program.building) {
+        return program.compiled;
+    }
+    
+    auto start_time = std::chrono::steady_clock::now();
+    if (!program.finish_build()) {
+        program.build_us += glow_elapsed_us(start_time);
+        return false;
+    }
+    
+    GLenum format;
+    std::vector<uint8_t> binary;
+    if (!directory.empty() && !binary_formats.empty() && program.get_binary(format, binary)) {
+        // Written aside and renamed, so a crash never leaves a partial entry
+        auto path = entry_path(program.cache_key);
+        auto temp_path = path + ".tmp";
+        glow_cache_header_t header;
+        std::memcpy(header.magic, GLOW_CACHE_MAGIC, sizeof(header.magic));
+        header.key = program.cache_key;
+        header.format = format;
+        header.length = static_cast<uint32_t>(binary.size());
+        
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        bool written = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) &&
+            file.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+        file.close();
+        if (!written || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            std::remove(temp_path.c_str());
+        }
+    }
+    
+    program.build_us += glow_elapsed_us(start_time);
+    return true;
+}
+
+bool glow_program_cache_t::build(glow_program_t& program, const std::string& vertex_source,
+    const std::string& fragment_source) {
+    return start(program, vertex_source, fragment_source) && finish(program);
+}
+
+void glow_program_t::set_uniform_array(GLint location, const std::vector<float>& values,
+    int components) {
+    if (location < 0 || values.empty()) return;
+    auto count = static_cast<GLsizei>(values.size() / components);
+    if (components == 4) {
+        glUniform4fv(location, count, values.data());
+    } else {
+        glUniform1fv(location, count, values.data());
+    }
+    uniform_uploads++;
+}
+
+bool glow_geometry_t::create() {
+    if (vao) return true;
+    
+    // 4x4 lattice of stop indices; the vertex shader resolves them via u_x_stops/u_y_stops
+    float lattice[4 * 4 * 2];
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 4; i++) {
+            lattice[(j * 4 + i) * 2 + 0] = static_cast<float>(i);
+            lattice[(j * 4 + i) * 2 + 1] = static_cast<float>(j);
+        }
+    }
+    
+    // Two triangles for every cell except the centre one
+    GLubyte indices[GLOW_RING_INDEX_COUNT];
+    int n = 0;
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) {
+            if (i == 1 && j == 1) continue;
+            GLubyte tl = j * 4 + i, tr = tl + 1, bl = tl + 4, br = bl + 1;
+            GLubyte cell[] = {tl, tr, br, tl, br, bl};
+            for (GLubyte idx : cell) indices[n++] = idx;
+        }
+    }
+    
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
+    if (!vao || !vbo || !ebo) {
+        return false;
+    }
+    
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(lattice), lattice, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    
+    // Lattice index attribute only (2 floats per vertex)
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    
+    // Same lattice and indices, plus one set of window attributes per instance
+    glGenVertexArrays(1, &instanced_vao);
+    glGenBuffers(1, &instance_vbo);
+    glBindVertexArray(instanced_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    const GLsizei stride = sizeof(glow_instance_t);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*)offsetof(glow_instance_t, border_box));
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*)offsetof(glow_instance_t, glow_color));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*)offsetof(glow_instance_t, glow_color_2));
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, stride,
+                          (void*)offsetof(glow_instance_t, time));
+    for (GLuint attr = 1; attr <= 4; attr++) {
+        glEnableVertexAttribArray(attr);
+        glVertexAttribDivisor(attr, 1);
+    }
+    
+    // The element buffer binding is VAO state, so only unbind the array buffer
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void glow_geometry_t::upload_instances(const std::vector<glow_instance_t>& instances) {
+    size_t bytes = instances.size() * sizeof(glow_instance_t);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    if (bytes > instance_capacity) {
+        // Grow geometrically so steady state never reallocates
+        instance_capacity = std::max(bytes, instance_capacity * 2);
+        glBufferData(GL_ARRAY_BUFFER, instance_capacity, nullptr, GL_STREAM_DRAW);
+    }
+    
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void glow_geometry_t::destroy() {
+    if (instance_vbo) glDeleteBuffers(1, &instance_vbo);
+    if (instanced_vao) glDeleteVertexArrays(1, &instanced_vao);
+    if (ebo) glDeleteBuffers(1, &ebo);
+    if (vbo) glDeleteBuffers(1, &vbo);
+    if (vao) glDeleteVertexArrays(1, &vao);
+    vao = vbo = ebo = instanced_vao = instance_vbo = 0;
+    instance_capacity = 0;
+}
+
+// Shader variants
+static std::string build_glow_preamble(uint32_t features) {
+    static const std::pair<uint32_t, const char*> defines[] = {
+        {GLOW_FEATURE_GRADIENT, "GLOW_GRADIENT"},
+        {GLOW_FEATURE_WOBBLE, "GLOW_WOBBLE"},
+        {GLOW_FEATURE_PULSE, "GLOW_PULSE"},
+        {GLOW_FEATURE_EDGE_NOISE, "GLOW_EDGE_NOISE"},
+        {GLOW_FEATURE_ROUNDED, "GLOW_ROUNDED"},
+        {GLOW_FEATURE_BORDER_ONLY, "GLOW_BORDER_ONLY"},
+        {GLOW_FEATURE_INSTANCED, "GLOW_INSTANCED"},
+        {GLOW_FEATURE_FALLOFF_PASS, "GLOW_FALLOFF_PASS"},
+        {GLOW_FEATURE_COMPOSITE_PASS, "GLOW_COMPOSITE_PASS"},
+        {GLOW_FEATURE_MERGED, "GLOW_MERGED"},
+    };
+    
+    std::string source = "#version 300 es\n";
+    source += "#define GLOW_MAX_MERGED " + std::to_string(GLOW_MAX_MERGED) + "\n";
+    for (auto& [flag, name] : defines) {
+        if (features & flag) {
+            source += std::string("#define ") + name + "\n";
+        }
+    }
+    
+    return source;
+}
+
+std::string build_glow_vertex_source(uint32_t features) {
+    return build_glow_preamble(features) + glow_variant_vertex_shader;
+}
+
+std::string build_glow_fragment_source(uint32_t features) {
+    return build_glow_preamble(features) + glow_fragment_shader;
+}
+
+// Ring placement
+float glow_config_t::glow_reach() const {
+    uint32_t mask = features();
+    if (mask & GLOW_FEATURE_BORDER_ONLY) {
+        return 0.0f;
+    }
+    
+    // Largest factor the falloff starts from at the outer border edge
+    float peak = glow_intensity;
+    if (mask & GLOW_FEATURE_PULSE) peak *= 1.05f;
+    if (mask & GLOW_FEATURE_EDGE_NOISE) peak *= 1.02f;
+    
+    // exp(-3 d / glow_radius) * peak > 0.001
+    float reach = glow_radius / 3.0f * std::log(peak / 0.001f);
+    return std::round(std::clamp(reach, 0.0f, glow_radius));
+}
+
+glow_config_t glow_config_t::to_device_pixels(float scale) const {
+    glow_config_t device = *this;
+    device.glow_radius *= scale;
+    device.border_width *= scale;
+    device.corner_radius *= scale;
+    if (max_device_radius > 0.0f) {
+        device.glow_radius = std::min(device.glow_radius, max_device_radius);
+    }
+    
+    return device;
+}
+
+glow_ring_t compute_glow_ring(float x, float y, float w, float h,
+    const glow_config_t& config, bool border_only) {
+    // Border-only variants have no falloff outside the box
+    float glow_r = border_only ? 0.0f : config.glow_reach();
+    
+    // Same corner clamp as the fragment shader; anything deeper than
+    // border_width + corner radius inside the box is discarded there
+    float corner_r = std::min(config.corner_radius, std::min(w, h) * 0.5f);
+    float inset_x = std::min(config.border_width + corner_r, w * 0.5f);
+    float inset_y = std::min(config.border_width + corner_r, h * 0.5f);
+    
+    return glow_ring_t{
+        {x - glow_r, x + inset_x, x + w - inset_x, x + w + glow_r},
+        {y - glow_r, y + inset_y, y + h - inset_y, y + h + glow_r},
+    };
+}
+
+glow_config_block_t make_glow_config_block(const glow_config_t& config) {
+    glow_config_block_t block{};
+    block.glow_radius = config.glow_radius;
+    block.glow_intensity = config.glow_intensity;
+    block.border_width = config.border_width;
+    block.gradient_angle = config.gradient_angle;
+    block.corner_radius = config.corner_radius;
+    block.glow_reach = config.glow_reach();
+    return block;
+}
+
+void set_glow_window_uniforms(glow_program_t& program, const glow_ring_t& ring,
+    const glow_instance_t& window) {
+    // Place the shared ring lattice
+    program.set_uniform(program.u_x_stops, ring.x[0], ring.x[1], ring.x[2], ring.x[3]);
+    program.set_uniform(program.u_y_stops, ring.y[0], ring.y[1], ring.y[2], ring.y[3]);
+    
+    auto& box = window.border_box;
+    auto& color = window.glow_color;
+    auto& color_2 = window.glow_color_2;
+    program.set_uniform(program.u_border_box, box[0], box[1], box[2], box[3]);
+    program.set_uniform(program.u_glow_color, color[0], color[1], color[2], color[3]);
+    program.set_uniform(program.u_glow_color_2, color_2[0], color_2[1], color_2[2], color_2[3]);
+    program.set_uniform(program.u_time, window.time);
+}
+
+} // namespace glow_decoration
+} // namespace wf
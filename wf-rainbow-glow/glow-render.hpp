@@ -0,0 +1,305 @@
+#pragma once
+
+/**
+ * The part of the glow renderer that only needs a GLES 3 context: shader
+ * programs and their variants, the ring lattice and the per-window draw
+ * state. It does not depend on Wayfire, so the headless benchmark in
+ * bench/ drives the very same code as the plugin.
+ */
+
+#include <GLES3/gl3.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace wf {
+namespace glow_decoration {
+
+// Binding point of the GlowConfig uniform block
+constexpr GLuint GLOW_CONFIG_BINDING = 0;
+
+// std140 layout of the GlowConfig uniform block
+struct glow_config_block_t {
+    float glow_radius;
+    float glow_intensity;
+    float border_width;
+    float gradient_angle;
+    float corner_radius;
+    float glow_reach;
+    float padding[2];
+};
+
+struct glow_program_t {
+    GLuint program = 0;
+    GLuint vertex_shader = 0;
+    GLuint fragment_shader = 0;
+    bool compiled = false;
+    bool building = false;  // between start_build() and finish_build()
+    
+    // Key of its glow_program_cache_t entry and the compositor time spent building it
+    uint64_t cache_key = 0;
+    double build_us = 0.0;
+    
+    // Info log of the compile or link step that failed, for the caller to report
+    std::string error_log;
+    
+    // Uniform uploads issued and skipped by the set_uniform helpers
+    uint64_t uniform_uploads = 0;
+    uint64_t uniform_uploads_skipped = 0;
+    
+    // Uniform locations (-1 for uniforms a program does not declare)
+    GLint u_resolution = -1;
+    GLint u_x_stops = -1;
+    GLint u_y_stops = -1;
+    GLint u_border_box = -1;
+    GLint u_glow_color = -1;
+    GLint u_glow_color_2 = -1;
+    GLint u_glow_radius = -1;
+    GLint u_glow_intensity = -1;
+    GLint u_border_width = -1;
+    GLint u_time = -1;
+    GLint u_gradient_angle = -1;
+    GLint u_corner_radius = -1;
+    GLint u_atlas = -1;
+    GLint u_atlas_size = -1;
+    GLint u_atlas_tile = -1;
+    GLint u_tile_origin = -1;
+    GLint u_half_res = -1;
+    GLint u_half_res_map = -1;
+    GLint u_box_count = -1;
+    GLint u_boxes = -1;
+    GLint u_box_colors = -1;
+    GLint u_box_colors_2 = -1;
+    GLint u_box_times = -1;
+    
+    // Builds from source, waiting for the compiler
+    bool compile_shaders(const char *vertex_source, const char *fragment_source);
+    
+    // The same in two steps: start_build() only queues the compile and link,
+    // so with KHR_parallel_shader_compile the driver's threads can do the work
+    // until finish_build() checks the result
+    bool start_build(const char *vertex_source, const char *fragment_source);
+    bool finish_build();
+    
+    // Links from a glGetProgramBinary() blob; false if the driver rejects it
+    bool load_binary(GLenum format, const std::vector<uint8_t>& binary);
+    bool get_binary(GLenum& format, std::vector<uint8_t>& binary) const;
+    
+    void use();
+    void destroy();
+    
+    // Uniform setters backed by a shadow copy of the program state;
+    // a value equal to the last upload is not sent again
+    void set_uniform(GLint location, float x);
+    void set_uniform(GLint location, float x, float y);
+    void set_uniform(GLint location, float x, float y, float z);
+    void set_uniform(GLint location, float x, float y, float z, float w);
+    void set_uniform(GLint location, const glm::vec4& v);
+    void set_uniform_int(GLint location, int v);
+    
+    // Arrays bypass the shadow copy; they change with every merged draw
+    void set_uniform_array(GLint location, const std::vector<float>& values, int components);
+    
+  private:
+    struct shadow_value_t {
+        bool valid = false;
+        float v[4];
+    };
+    
+    std::vector<shadow_value_t> shadow;
+    bool shadow_matches(GLint location, const float (&v)[4]);
+    
+    bool check_shader(GLuint shader);
+    bool check_link();
+    
+    // Uniform locations and block binding of a linked program
+    void init_program();
+};
+
+/**
+ * Builds programs from linked binaries kept on disk (glGetProgramBinary), so
+ * only the first start after a driver or shader change runs the GLSL
+ * compiler. Entries are keyed by a hash of the driver strings and both
+ * shader sources; a binary the driver rejects is deleted and the program is
+ * built from source again. Source builds use KHR_parallel_shader_compile
+ * when the driver has it.
+ */
+class glow_program_cache_t {
+  public:
+    // Where binaries are kept; empty keeps none
+    std::string directory;
+    
+    // Programs linked from a cached binary, and built from source
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    
+    /**
+     * Links the program from its cached binary, or starts building it from
+     * source, in which case program.building is set until finish(). Needs
+     * the context current. Returns false if the program cannot be built.
+     */
+    bool start(glow_program_t& program, const std::string& vertex_source,
+        const std::string& fragment_source);
+    
+    // Whether finish() would not wait for the compiler
+    bool is_ready(const glow_program_t& program);
+    
+    // Completes a source build and stores its binary
+    bool finish(glow_program_t& program);
+    
+    // start() and finish() in one go
+    bool build(glow_program_t& program, const std::string& vertex_source,
+        const std::string& fragment_source);
+    
+  private:
+    bool driver_checked = false;
+    bool parallel_compile = false;
+    std::vector<GLint> binary_formats;
+    std::string driver;
+    
+    void check_driver();
+    std::string entry_path(uint64_t key) const;
+};
+
+// Per-window attributes of one instanced glow draw
+struct glow_instance_t {
+    float border_box[4];
+    float glow_color[4];
+    float glow_color_2[4];
+    float time;
+};
+
+/**
+ * Shared 9-slice ring lattice, created once with the main program and
+ * reused by every draw. The instanced VAO adds a streaming per-window
+ * attribute buffer that only grows, so batches never allocate GL objects.
+ */
+struct glow_geometry_t {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    GLuint instanced_vao = 0;
+    GLuint instance_vbo = 0;
+    size_t instance_capacity = 0;
+    
+    bool create();
+    void upload_instances(const std::vector<glow_instance_t>& instances);
+    void destroy();
+};
+
+// Shader features; each set of flags compiles into its own program variant
+enum glow_feature_t : uint32_t {
+    GLOW_FEATURE_GRADIENT    = 1 << 0,
+    GLOW_FEATURE_WOBBLE      = 1 << 1,  // time/position wobble of the gradient
+    GLOW_FEATURE_PULSE       = 1 << 2,
+    GLOW_FEATURE_EDGE_NOISE  = 1 << 3,
+    GLOW_FEATURE_ROUNDED     = 1 << 4,
+    GLOW_FEATURE_BORDER_ONLY = 1 << 5,
+    GLOW_FEATURE_INSTANCED   = 1 << 6,  // per-window values from the instance buffer
+    GLOW_FEATURE_FALLOFF_PASS   = 1 << 7,  // half-resolution falloff, see glow_half_res_buffer_t
+    GLOW_FEATURE_COMPOSITE_PASS = 1 << 8,  // upsampling of that falloff
+    GLOW_FEATURE_MERGED         = 1 << 9,  // nearest of several windows, see GLOW_MAX_MERGED
+};
+
+// Windows one merged draw shades as a single field (uniform array size)
+constexpr int GLOW_MAX_MERGED = 16;
+
+// Full shader sources for the given feature mask
+std::string build_glow_vertex_source(uint32_t features);
+std::string build_glow_fragment_source(uint32_t features);
+
+struct glow_config_t {
+    glm::vec4 active_color{1.0f, 0.5f, 0.0f, 1.0f};
+    glm::vec4 inactive_color{0.3f, 0.3f, 0.3f, 1.0f};
+    glm::vec4 gradient_color_2{0.0f, 0.5f, 1.0f, 1.0f};
+    float glow_radius = 20.0f;
+    float glow_intensity = 1.0f;
+    float border_width = 2.0f;
+    float animation_speed = 1.0f;
+    bool enable_gradient = false;
+    float gradient_angle = 45.0f;
+    float corner_radius = 10.0f;
+    float max_device_radius = 0.0f;  // cap of glow_radius in device pixels, 0 for none
+    bool batch_rendering = false;
+    bool half_resolution = false;
+    bool merge_glows = false;
+    
+    // Quality governor, budgets in percent of the output's frame time
+    bool adaptive_quality = false;
+    float quality_budget_high = 25.0f;
+    float quality_budget_low = 10.0f;
+    int quality_downgrade_frames = 15;
+    int quality_upgrade_frames = 180;
+    int lowest_quality_tier = 4;
+    
+    // Pulse, edge noise and gradient wobble are all driven by the shader time,
+    // which only advances with a non-zero animation speed. Pulse and noise
+    // modulate the falloff, so a border-only look moves only with a gradient.
+    bool is_time_dependent() const {
+        return (animation_speed > 0.0f) && ((glow_intensity > 0.0f) || enable_gradient);
+    }
+    
+    // Without gradient and edge noise the glow shape depends only on the
+    // radii, so it can be sampled from the baked atlas
+    bool can_use_cached_glow() const {
+        return !enable_gradient && !is_time_dependent();
+    }
+    
+    // Smallest shader variant that reproduces this configuration
+    uint32_t features() const {
+        uint32_t mask = 0;
+        if (enable_gradient) mask |= GLOW_FEATURE_GRADIENT | GLOW_FEATURE_WOBBLE;
+        if (is_time_dependent()) mask |= GLOW_FEATURE_PULSE | GLOW_FEATURE_EDGE_NOISE;
+        if (corner_radius > 0.0f) mask |= GLOW_FEATURE_ROUNDED;
+        if (glow_intensity <= 0.0f) {
+            // Pulse and noise only modulate the falloff
+            mask |= GLOW_FEATURE_BORDER_ONLY;
+            mask &= ~(GLOW_FEATURE_PULSE | GLOW_FEATURE_EDGE_NOISE);
+        }
+        return mask;
+    }
+    
+    /**
+     * How far outside the box the falloff is drawn, in whole pixels. The
+     * shader discards glow factors of 0.001 and below, which faint glows
+     * reach before glow_radius.
+     */
+    float glow_reach() const;
+    
+    // The radii in device pixels of an output with this scale, the glow
+    // radius capped at max_device_radius
+    glow_config_t to_device_pixels(float scale) const;
+};
+
+// Number of indices in the ring lattice (8 border cells, hollow centre)
+constexpr GLsizei GLOW_RING_INDEX_COUNT = 8 * 6;
+
+/**
+ * Column and row edges of the 9-slice glow ring around a view.
+ * The centre cell is inset far enough that the shader would discard
+ * every pixel in it, so it is never rasterized.
+ */
+struct glow_ring_t {
+    float x[4];
+    float y[4];
+};
+
+
+// With border_only, the ring ends at the outer border edge
+glow_ring_t compute_glow_ring(float x, float y, float width, float height,
+    const glow_config_t& config, bool border_only = false);
+
+// Contents of the GlowConfig uniform block for a configuration
+glow_config_block_t make_glow_config_block(const glow_config_t& config);
+
+/**
+ * Per-window uniforms of a non-instanced draw, with the ring and the border
+ * box of the window given relative to the viewport; unchanged values are
+ * skipped by the shadow cache.
+ */
+void set_glow_window_uniforms(glow_program_t& program, const glow_ring_t& ring,
+    const glow_instance_t& window);
+
+} // namespace glow_decoration
+} // namespace wf
@@ -0,0 +1,133 @@
+#pragma once
+
+/**
+ * Hot-path instrumentation of the glow, built only with -Dstats=true, which
+ * defines GLOW_STATS. Without it GLOW_STAT() drops its argument, so regular
+ * builds carry no counters, clock reads or branches for it.
+ */
+
+#ifdef GLOW_STATS
+#define GLOW_STAT(...) __VA_ARGS__
+#else
+#define GLOW_STAT(...)
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace wf {
+namespace glow_decoration {
+
+/**
+ * Log-linear histogram: every power of two is split into SUB_BUCKETS
+ * buckets, so percentiles are within 19% of the exact value. Adding a sample
+ * never allocates.
+ */
+struct glow_histogram_t {
+    static constexpr int SUB_BUCKETS = 4;
+    static constexpr int BUCKETS = 1 + 40 * SUB_BUCKETS;
+    
+    uint64_t buckets[BUCKETS] = {};
+    uint64_t count = 0;
+    double sum = 0.0;
+    double max = 0.0;
+    
+    void add(double value) {
+        int bucket = 0;
+        if (value >= 1.0) {
+            // value = mantissa * 2^exponent with mantissa in [0.5, 1)
+            int exponent;
+            double mantissa = std::frexp(value, &exponent);
+            int sub = static_cast<int>((mantissa - 0.5) * 2 * SUB_BUCKETS);
+            bucket = std::min(1 + (exponent - 1) * SUB_BUCKETS + sub, BUCKETS - 1);
+        }
+        
+        buckets[bucket]++;
+        count++;
+        sum += value;
+        max = std::max(max, value);
+    }
+    
+    double mean() const {
+        return count ? sum / count : 0.0;
+    }
+    
+    // Upper bound of the bucket reached by the given fraction of the samples
+    double percentile(double fraction) const {
+        uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * count));
+        uint64_t seen = 0;
+        for (int bucket = 0; bucket < BUCKETS; bucket++) {
+            seen += buckets[bucket];
+            if (seen >= rank && seen > 0) {
+                if (bucket == 0) {
+                    return std::min(1.0, max);
+                }
+                
+                if (bucket == BUCKETS - 1) {
+                    return max;
+                }
+                
+                int exponent = (bucket - 1) / SUB_BUCKETS + 1;
+                int sub = (bucket - 1) % SUB_BUCKETS;
+                double upper = (0.5 + (sub + 1) * 0.5 / SUB_BUCKETS) * std::ldexp(1.0, exponent);
+                return std::min(upper, max);
+            }
+        }
+        
+        return 0.0;
+    }
+};
+
+// Microseconds since start, for the CPU time histograms
+inline double glow_elapsed_us(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count();
+}
+
+/**
+ * Process-wide counters, held by the runtime. Frame values are summed over
+ * the render() calls of one output frame and become one histogram sample
+ * when that frame is done; animation values likewise per animation tick.
+ */
+struct glow_stats_t {
+    // One sample per output frame
+    glow_histogram_t draws_per_frame;
+    glow_histogram_t pixels_per_frame;  // damaged glow pixels redrawn
+    glow_histogram_t render_us;         // CPU time in render()
+    
+    // One sample per animation tick
+    glow_histogram_t animation_us;      // CPU time in update_animation()
+    glow_histogram_t animation_damage;  // pixels damaged by set_animation_time()
+    
+    // One sample per shader program built or loaded from the program cache
+    glow_histogram_t compile_us;
+    
+    uint64_t animation_ticks = 0;
+    uint64_t animation_wakeups = 0;     // ticking resumed after being idle
+    
+    // Totals of the frame and the tick in progress
+    uint64_t frame_draws = 0;
+    double frame_pixels = 0.0;
+    double frame_render_us = 0.0;
+    double tick_damage = 0.0;
+    
+    void end_frame() {
+        draws_per_frame.add(frame_draws);
+        pixels_per_frame.add(frame_pixels);
+        render_us.add(frame_render_us);
+        frame_draws = 0;
+        frame_pixels = frame_render_us = 0.0;
+    }
+    
+    void end_tick(double elapsed_us) {
+        animation_ticks++;
+        animation_us.add(elapsed_us);
+        animation_damage.add(tick_damage);
+        tick_damage = 0.0;
+    }
+};
+
+} // namespace glow_decoration
+} // namespace wf
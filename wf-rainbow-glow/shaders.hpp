@@ -3,89 +3,341 @@
 namespace wf {
 namespace glow_decoration {
 
-// Vertex shader - simple passthrough (vertices in NDC)
-static const char* glow_vertex_shader = R"glsl(
+// Atlas sampling vertex shader - places the shared 9-slice ring lattice (viewport pixels)
+static const char* const glow_vertex_shader = R"glsl(
 #version 300 es
 precision highp float;
 
-layout(location = 0) in vec2 a_position;
+layout(location = 0) in vec2 a_position;   // lattice index (0..3, 0..3)
+
+uniform vec2 u_resolution;
+uniform vec4 u_x_stops;        // outer left, inner left, inner right, outer right
+uniform vec4 u_y_stops;        // outer top, inner top, inner bottom, outer bottom
+
+out vec2 v_position;
 
 void main() {
-    gl_Position = vec4(a_position, 0.0, 1.0);
+    vec2 pos = vec2(u_x_stops[int(a_position.x)], u_y_stops[int(a_position.y)]);
+    gl_Position = vec4(pos / u_resolution * 2.0 - 1.0, 0.0, 1.0);
+    v_position = pos;
 }
 )glsl";
 
-// Fragment shader - same as original working version
-static const char* glow_fragment_shader = R"glsl(
-#version 300 es
+// Variant vertex shader body - places the ring lattice either from the stop
+// uniforms or, with GLOW_INSTANCED, from the per-window instance attributes
+// exactly like compute_glow_ring(). Everything that is constant across a
+// window is computed here once and handed to the fragment stage as flat
+// varyings. Built with the same preamble as the fragment shader.
+static const char* const glow_variant_vertex_shader = R"glsl(
 precision highp float;
 
+layout(location = 0) in vec2 a_position;   // lattice index (0..3, 0..3)
+
 uniform vec2 u_resolution;
+
+// Config-wide values, uploaded once per configuration change
+layout(std140) uniform GlowConfig {
+    float u_glow_radius;
+    float u_glow_intensity;
+    float u_border_width;
+    float u_gradient_angle;
+    float u_corner_radius;
+    float u_glow_reach;        // whole pixels the falloff is drawn out to
+};
+
+#ifdef GLOW_INSTANCED
+layout(location = 1) in vec4 a_border_box;
+layout(location = 2) in vec4 a_glow_color;
+layout(location = 3) in vec4 a_glow_color_2;
+layout(location = 4) in float a_time;
+#define u_border_box a_border_box
+#define u_glow_color a_glow_color
+#define u_glow_color_2 a_glow_color_2
+#define u_time a_time
+#else
+uniform vec4 u_x_stops;        // outer left, inner left, inner right, outer right
+uniform vec4 u_y_stops;        // outer top, inner top, inner bottom, outer bottom
 uniform vec4 u_border_box;     // x, y, width, height of the window
 uniform vec4 u_glow_color;
 uniform vec4 u_glow_color_2;
-uniform float u_glow_radius;
-uniform float u_glow_intensity;
-uniform float u_border_width;
 uniform float u_time;
-uniform int u_enable_gradient;
-uniform float u_gradient_angle;
-uniform float u_corner_radius;
+#endif
+
+#ifdef GLOW_MERGED
+out vec2 v_position;            // fragment position in viewport pixels
+#else
+out vec2 v_local;               // fragment position relative to the window centre
+flat out vec2 v_half_size;
+flat out float v_corner_r;
+flat out vec4 v_gradient_axes;  // rotated gradient axes, pre-divided by v_half_size
+flat out float v_glow_gain;     // intensity with the pulse applied
+flat out float v_time;
+flat out vec4 v_glow_color;
+flat out vec4 v_glow_color_2;
+#endif
+
+void main() {
+#ifdef GLOW_MERGED
+    // Each instance is one rectangle of the merged rings, covered by the top
+    // middle cell of the lattice; every other cell collapses to nothing
+    vec2 origin = u_border_box.xy;
+    vec2 end = u_border_box.xy + u_border_box.zw;
+    vec4 xStops = vec4(origin.x, origin.x, end.x, end.x);
+    vec4 yStops = vec4(origin.y, end.y, end.y, end.y);
+    vec2 pos = vec2(xStops[int(a_position.x)], yStops[int(a_position.y)]);
+    gl_Position = vec4(pos / u_resolution * 2.0 - 1.0, 0.0, 1.0);
+    v_position = pos;
+#else
+    vec2 halfSize = u_border_box.zw * 0.5;
+    vec2 center = u_border_box.xy + halfSize;
+    float cornerR = min(u_corner_radius, min(halfSize.x, halfSize.y));
+    
+#ifdef GLOW_INSTANCED
+    float glowR = u_glow_reach;
+    vec2 origin = u_border_box.xy;
+    vec2 size = u_border_box.zw;
+    vec2 inset = min(vec2(u_border_width + cornerR), halfSize);
+    
+    vec4 xStops = vec4(origin.x - glowR, origin.x + inset.x,
+                       origin.x + size.x - inset.x, origin.x + size.x + glowR);
+    vec4 yStops = vec4(origin.y - glowR, origin.y + inset.y,
+                       origin.y + size.y - inset.y, origin.y + size.y + glowR);
+#else
+    vec4 xStops = u_x_stops;
+    vec4 yStops = u_y_stops;
+#endif
+    
+    vec2 pos = vec2(xStops[int(a_position.x)], yStops[int(a_position.y)]);
+    gl_Position = vec4(pos / u_resolution * 2.0 - 1.0, 0.0, 1.0);
+    
+    // Affine in screen space, so the interpolated value is exact per fragment
+    v_local = pos - center;
+    v_half_size = halfSize;
+    v_corner_r = cornerR;
+    
+    float angle = radians(u_gradient_angle);
+    float c = cos(angle);
+    float s = sin(angle);
+    v_gradient_axes = vec4(c, -s, s, c) / halfSize.xyxy;
+    
+#ifdef GLOW_PULSE
+    v_glow_gain = u_glow_intensity * (1.0 + sin(u_time * 2.0) * 0.05);
+#else
+    v_glow_gain = u_glow_intensity;
+#endif
+    v_time = u_time;
+    v_glow_color = u_glow_color;
+    v_glow_color_2 = u_glow_color_2;
+#endif
+}
+)glsl";
+
+// Fragment shader body - specialized per feature set by a #define preamble,
+// see build_glow_fragment_source(). Must not contain a #version line.
+static const char* const glow_fragment_shader = R"glsl(
+precision highp float;
+
+// Config-wide values, uploaded once per configuration change
+layout(std140) uniform GlowConfig {
+    float u_glow_radius;
+    float u_glow_intensity;
+    float u_border_width;
+    float u_gradient_angle;
+    float u_corner_radius;
+    float u_glow_reach;
+};
+
+#ifdef GLOW_MERGED
+// Neighbouring windows shaded as one field: every fragment takes its
+// distance and look from the nearest window, so overlapping rings are
+// neither shaded nor blended twice
+uniform int u_box_count;
+uniform vec4 u_boxes[GLOW_MAX_MERGED];         // x, y, width, height
+uniform vec4 u_box_colors[GLOW_MAX_MERGED];
+uniform vec4 u_box_colors_2[GLOW_MAX_MERGED];
+uniform float u_box_times[GLOW_MAX_MERGED];
+
+in vec2 v_position;
+
+// What the vertex stage passes for a single window, set by selectNearestWindow()
+vec2 v_local;
+vec2 v_half_size;
+float v_corner_r;
+vec4 v_gradient_axes;
+float v_glow_gain;
+float v_time;
+vec4 v_glow_color;
+vec4 v_glow_color_2;
+#else
+in vec2 v_local;
+flat in vec2 v_half_size;
+flat in float v_corner_r;
+flat in vec4 v_gradient_axes;
+flat in float v_glow_gain;
+flat in float v_time;
+flat in vec4 v_glow_color;
+flat in vec4 v_glow_color_2;
+#endif
+
+#ifdef GLOW_COMPOSITE_PASS
+uniform sampler2D u_half_res;
+uniform vec4 u_half_res_map;   // viewport origin, 0.5 / texture size
+#endif
 
 out vec4 fragColor;
 
+#ifdef GLOW_ROUNDED
 float sdRoundedBox(vec2 p, vec2 b, float r) {
     vec2 q = abs(p) - b + r;
     return min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - r;
 }
+#else
+float sdBox(vec2 p, vec2 b) {
+    vec2 q = abs(p) - b;
+    return min(max(q.x, q.y), 0.0) + length(max(q, 0.0));
+}
+#endif
+
+#ifdef GLOW_EDGE_NOISE
+// Diamond angle: monotonic in the polar angle like atan(), but only one
+// division. Folded onto half a turn, which the 8-lobe noise cannot tell apart.
+// Evaluated per fragment: it is not affine in screen space, and the edge cells
+// of the lattice straddle the window's axes, so an interpolated varying would
+// bend the lobes.
+float pseudoAngle(vec2 p) {
+    float r = p.y / (abs(p.x) + abs(p.y));
+    return p.x >= 0.0 ? r : -r;
+}
+#endif
 
-vec2 rotate2D(vec2 p, float angle) {
+#ifndef GLOW_BORDER_ONLY
+float glowFalloff(float dist, vec2 p) {
+    float glowDist = dist / u_glow_radius;
+    float glowFactor = exp(-glowDist * 3.0) * v_glow_gain;
+#ifdef GLOW_EDGE_NOISE
+    // 8 lobes per turn: 4 pseudo-angle units cover a full turn
+    float edgeNoise = sin(pseudoAngle(p) * 12.566371 + v_time) * 0.02;
+    glowFactor += edgeNoise * glowFactor;
+#endif
+    return glowFactor;
+}
+#endif
+
+#ifdef GLOW_MERGED
+float windowDistance(vec2 p, vec2 halfSize, float cornerR) {
+#ifdef GLOW_ROUNDED
+    return sdRoundedBox(p, halfSize, cornerR);
+#else
+    return sdBox(p, halfSize);
+#endif
+}
+
+void selectNearestWindow() {
+    float nearest = 1e20;
+    int index = 0;
+    for (int i = 0; i < GLOW_MAX_MERGED; i++) {
+        if (i >= u_box_count) {
+            break;
+        }
+        
+        vec2 halfSize = u_boxes[i].zw * 0.5;
+        float cornerR = min(u_corner_radius, min(halfSize.x, halfSize.y));
+        float dist = windowDistance(v_position - u_boxes[i].xy - halfSize, halfSize, cornerR);
+        if (dist < nearest) {
+            nearest = dist;
+            index = i;
+        }
+    }
+    
+    // Same values as the vertex stage computes for one window
+    v_half_size = u_boxes[index].zw * 0.5;
+    v_local = v_position - u_boxes[index].xy - v_half_size;
+    v_corner_r = min(u_corner_radius, min(v_half_size.x, v_half_size.y));
+    
+    float angle = radians(u_gradient_angle);
     float c = cos(angle);
     float s = sin(angle);
-    return vec2(p.x * c - p.y * s, p.x * s + p.y * c);
+    v_gradient_axes = vec4(c, -s, s, c) / v_half_size.xyxy;
+    
+    v_time = u_box_times[index];
+#ifdef GLOW_PULSE
+    v_glow_gain = u_glow_intensity * (1.0 + sin(v_time * 2.0) * 0.05);
+#else
+    v_glow_gain = u_glow_intensity;
+#endif
+    v_glow_color = u_box_colors[index];
+    v_glow_color_2 = u_box_colors_2[index];
 }
+#endif
 
 void main() {
-    // Use gl_FragCoord.y directly (no inversion)
-    vec2 uv = gl_FragCoord.xy;
-    vec2 center = u_border_box.xy + u_border_box.zw * 0.5;
-    vec2 halfSize = u_border_box.zw * 0.5;
-    vec2 p = uv - center;
+#ifdef GLOW_MERGED
+    selectNearestWindow();
+#endif
+    vec2 p = v_local;
     
-    float cornerR = min(u_corner_radius, min(halfSize.x, halfSize.y));
-    float dist = sdRoundedBox(p, halfSize, cornerR);
+#ifdef GLOW_ROUNDED
+    float dist = sdRoundedBox(p, v_half_size, v_corner_r);
+#else
+    float dist = sdBox(p, v_half_size);
+#endif
     
     float innerEdge = -u_border_width;
     float outerEdge = 0.0;
     float glowEnd = u_glow_radius;
     
-    vec4 glowColor = u_glow_color;
-    
-    if (u_enable_gradient == 1) {
-        float angle = radians(u_gradient_angle);
-        vec2 rotatedP = rotate2D(p / halfSize, angle);
-        float gradientPos = rotatedP.x * 0.5 + 0.5;
-        gradientPos += sin(u_time * 0.5 + rotatedP.y * 2.0) * 0.1;
-        gradientPos = clamp(gradientPos, 0.0, 1.0);
-        glowColor = mix(u_glow_color, u_glow_color_2, gradientPos);
+#ifdef GLOW_COMPOSITE_PASS
+    // Upsampled falloff only; the border band is drawn at full resolution
+    if (dist <= outerEdge || dist >= glowEnd) {
+        discard;
     }
+    fragColor = texture(u_half_res, (gl_FragCoord.xy - u_half_res_map.xy) * u_half_res_map.zw);
+    return;
+#endif
     
-    float pulse = 1.0 + sin(u_time * 2.0) * 0.05;
+    vec4 glowColor = v_glow_color;
+    
+#ifdef GLOW_GRADIENT
+    float gradientPos = dot(p, v_gradient_axes.xy) * 0.5 + 0.5;
+#ifdef GLOW_WOBBLE
+    gradientPos += sin(v_time * 0.5 + dot(p, v_gradient_axes.zw) * 2.0) * 0.1;
+#endif
+    gradientPos = clamp(gradientPos, 0.0, 1.0);
+    glowColor = mix(v_glow_color, v_glow_color_2, gradientPos);
+#endif
+    
+#ifdef GLOW_BORDER_ONLY
+    // Solid border band only, no falloff
+    if (dist <= innerEdge || dist > outerEdge) {
+        discard;
+    }
+    float glowFactor = 1.0;
+#else
     float glowFactor = 0.0;
     
+#ifdef GLOW_FALLOFF_PASS
+    // Falloff only, continued through the border band so that upsampling
+    // sees no step at the outer border edge
+    if (dist < glowEnd) {
+        glowFactor = glowFalloff(max(dist, 0.0), p);
+    }
+#else
     if (dist > innerEdge && dist < glowEnd) {
         if (dist <= outerEdge) {
             glowFactor = 1.0;
         } else {
-            float glowDist = dist / u_glow_radius;
-            glowFactor = exp(-glowDist * 3.0) * u_glow_intensity * pulse;
-            float edgeNoise = sin(atan(p.y, p.x) * 8.0 + u_time) * 0.02;
-            glowFactor += edgeNoise * glowFactor;
+            glowFactor = glowFalloff(dist, p);
         }
     }
+#endif
+#endif
     
     if (glowFactor > 0.001) {
+#ifdef GLOW_FALLOFF_PASS
+        float bloom = 1.0;
+#else
         float bloom = (dist <= outerEdge && dist > innerEdge) ? 1.2 : 1.0;
+#endif
         vec3 finalColor = glowColor.rgb * bloom;
         float alpha = glowColor.a * glowFactor;
         fragColor = vec4(finalColor * alpha, alpha);
@@ -95,5 +347,105 @@ void main() {
 }
 )glsl";
 
+// Atlas bake vertex shader - covers the viewport set to the atlas entry
+static const char* const glow_bake_vertex_shader = R"glsl(
+#version 300 es
+precision highp float;
+
+void main() {
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)glsl";
+
+// Atlas bake fragment shader - one top-left corner tile plus an edge profile row.
+// Tile texel (u, v) lies glow_radius - u / glow_radius - v outside the box edges.
+// Stores the solid border coverage in R and the bare exp() falloff in G.
+static const char* const glow_bake_fragment_shader = R"glsl(
+#version 300 es
+precision highp float;
+
+uniform vec2 u_tile_origin;
+uniform float u_glow_radius;
+uniform float u_border_width;
+uniform float u_corner_radius;
+
+out vec4 fragColor;
+
+void main() {
+    vec2 t = gl_FragCoord.xy - u_tile_origin;
+    vec2 outside = vec2(u_glow_radius) - t;
+    float size = ceil(u_glow_radius + u_border_width + u_corner_radius);
+    
+    float dist;
+    if (t.y > size) {
+        // Edge profile: distance perpendicular to a straight edge
+        dist = outside.x;
+    } else {
+        vec2 q = outside + u_corner_radius;
+        dist = min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - u_corner_radius;
+    }
+    
+    float border = (dist > -u_border_width && dist <= 0.0) ? 1.0 : 0.0;
+    float falloff = (dist > 0.0 && dist < u_glow_radius) ? exp(-dist / u_glow_radius * 3.0) : 0.0;
+    fragColor = vec4(border, falloff, 0.0, 1.0);
+}
+)glsl";
+
+// Cached fragment shader - mirrored 9-slice sampling of a baked atlas entry
+static const char* const glow_cached_fragment_shader = R"glsl(
+#version 300 es
+precision highp float;
+
+uniform sampler2D u_atlas;
+uniform vec2 u_atlas_size;
+uniform vec3 u_atlas_tile;     // x, y, tile size of the atlas entry
+uniform vec4 u_border_box;
+uniform vec4 u_glow_color;
+uniform float u_glow_radius;
+uniform float u_glow_intensity;
+uniform float u_border_width;
+uniform float u_corner_radius;
+uniform float u_time;
+
+in vec2 v_position;            // relative to the viewport, like u_border_box
+
+out vec4 fragColor;
+
+void main() {
+    vec2 center = u_border_box.xy + u_border_box.zw * 0.5;
+    vec2 halfSize = u_border_box.zw * 0.5;
+    vec2 outside = abs(v_position - center) - halfSize;
+    
+    float inset = u_border_width + u_corner_radius;
+    float size = u_atlas_tile.z;
+    
+    // Straight edges read the profile row, corners the (symmetric) corner tile
+    vec2 texel;
+    if (outside.y < -inset) {
+        texel = vec2(u_glow_radius - outside.x, size + 0.5);
+    } else if (outside.x < -inset) {
+        texel = vec2(u_glow_radius - outside.y, size + 0.5);
+    } else {
+        texel = clamp(vec2(u_glow_radius) - outside, vec2(0.5), vec2(size - 0.5));
+    }
+    texel.x = clamp(texel.x, 0.5, size - 0.5);
+    
+    vec4 s = texture(u_atlas, (u_atlas_tile.xy + texel) / u_atlas_size);
+    
+    float pulse = 1.0 + sin(u_time * 2.0) * 0.05;
+    float glowFactor = s.r + s.g * u_glow_intensity * pulse;
+    
+    if (glowFactor > 0.001) {
+        float bloom = mix(1.0, 1.2, s.r);
+        vec3 finalColor = u_glow_color.rgb * bloom;
+        float alpha = u_glow_color.a * glowFactor;
+        fragColor = vec4(finalColor * alpha, alpha);
+    } else {
+        discard;
+    }
+}
+)glsl";
+
 } // namespace glow_decoration
 } // namespace wf
\ No newline at end of file